@@ -32,358 +32,349 @@
 #include <fstream>
 #include <iostream>
 #include <string>
+#include <vector>
 #include <sys/stat.h>
 #include <algorithm>
-#include <vector>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
 using namespace std;
 
+#include "stein_batch.h"
+#include "stein_fsw.h"
+#include "stein_hexparse.h"
+#include "stein_index.h"
+#include "stein_input.h"
+#include "stein_kernel.h"
+#include "stein_output.h"
+#include "stein_options.h"
+#include "stein_pipeline.h"
+#include "stein_quarantine.h"
+#include "stein_stats.h"
+#include "stein_timeseries.h"
 
-// function to tokenize a string according to some delimited, 
-// taken from: <http://www.oopweb.com/CPP/Documents/CPPHOWTO/
-//                      Volume/C++Programming-HOWTO-7.html> 
-void Tokenize(const string& str,
-                        vector<string>& tokens,
-                        const string& delimiters = " ")
-{
-    // Skip delimiters at beginning.
-    string::size_type lastPos = str.find_first_not_of(delimiters, 0);
-    // Find first "non-delimiter".
-    string::size_type pos     = str.find_first_of(delimiters, lastPos);
 
-    while (string::npos != pos || string::npos != lastPos)
-    {
-        // Found a token, add it to the vector.
-        tokens.push_back(str.substr(lastPos, pos - lastPos));
-        // Skip delimiters.  Note the "not_of"
-        lastPos = str.find_first_not_of(delimiters, pos);
-        // Find next "non-delimiter"
-        pos = str.find_first_of(delimiters, lastPos);
-    }
-}
+// PACKET INDEX
+// "--build-index" makes one pass over the dump and records, for every
+//   packet, the offset of its line, its packet time and its events per
+//   EVCODE in a sidecar file (see stein_index.h); "--from / --to" then
+//   decode only the packets of a packet-number or packet-time range,
+//   reading nothing else of the dump.
 
-// function to extract events from the 495-byte STEIN data block
-void ExtractEvents(uint8_t stein_frame[], uint32_t event_log[]) {
-    // 495-byte block, comprising 198 events of 20 bits each
-    // So.. every 5 bytes gives us 2 complete STEIN events
-    uint16_t increment = 5;             // (bytes)
-    uint16_t n_events = 198;            // (events)
-    uint32_t working_bytes [increment];  // 5-byte chunk to work with 
+// index every packet of "fileName"; returns false if it cannot be read.
+//   A packet that fails validation ("checks", as when decoding) holds no
+//   events, and takes the time of the last good packet before it, so a
+//   glitched timestamp cannot throw off the --from / --to time search
+static bool BuildPacketIndex(const char *fileName, const PacketChecks &checks,
+                             PacketIndexWriter &index) {
+    InputSource input;
+    if (!input.Open(fileName, false, false)) return false;     // (never compressed)
 
-    // storage arrays (16-bit should be ok)
-    uint32_t event1, event2;            // for processing
-    
-    for (uint16_t i=0; i <= ((n_events/2) -1); i++) {
-        // populate "working_bytes"
-        for (uint16_t j=0; j < increment; j++) {
-            working_bytes[j] = stein_frame[j + i*increment];
-        }
-        // split, bitshift, and re-construct event values
-        event1 = ((working_bytes[2] & 15L) << 16) + (working_bytes[1] << 8) + (working_bytes[0]);
-        event2 = (working_bytes[4] << 12) + (working_bytes[3] << 4) + (working_bytes[2] >> 4);
-        event_log[2*i] = event1;        // place in event_log
-        event_log[2*i + 1] = event2;    //      """
-    }
-    // no return value needed, as we're modifying event_log itself (we hope!)
-}
+    FswPacketDecoder validator(checks);
+    uint8_t     packet_bytes [packet_size];
+    EventBatch  events;
+    uint64_t    n_lines = 0;
+    uint64_t    last_time = 0;              // (of the last good packet)
+    while (true) {
+        bool more = input.Fill();
+        while (input.Available()) {
+            const uint8_t *data = input.Data();
+            size_t len = LineChunkLength(data, input.Available(), DecodePipeline::chunk_size, !more);
+            if (len == 0) break;                // (need more input)
 
-void Parse_EventReport(uint32_t stein_event, int16_t &evcode, int16_t &add, int16_t &det_id, int16_t &time_stamp, int32_t &event_data) {
-   evcode = stein_event >> 18;
-   switch (evcode) {
-    case 0:     // (i.e., is a data packet)
-        // no ADD bit (0 bits; all bits dropped)
-        add=-1;
-        // DET_ID (5 bits)
-        det_id = (stein_event >> (20 - (2+5))) & 31;
-        // TIMESTAMP (6 bits; 2 LSB dropped)
-        time_stamp = (stein_event >> (20 - (2+5+6))) & 63;
-        // EVENT_DATA (7 bits; 9 bits dropped via log-binning)
-        event_data = (stein_event >> (20 - (2+5+6+7))) & 127;
-        break;
-    case 1:     // (i.e., Sweep checksum/# of triggers per second)
-        // no ADD bit (0 bits; all bits dropped)
-        add = -1;
-        // no DET_ID bits (0 bits; all bits dropped)
-        det_id = -1;
-        // TIMESTAMP (6 bits; 2 MSB dropped)
-        time_stamp = (stein_event >> (20 - (2+6))) & 63;
-        // DATA (12 bits; 4 lower bits dropped)
-        event_data = (stein_event >> (20 - (2+6+12))) & 4095;
-       break;
-    case 2:     // (i.e., Sweep checksum/# of events per second)
-        // no ADD bit (0 bits; all bits dropped)
-        add = -1;
-        // no DET_ID bits (0 bits; all bits dropped)
-        det_id = -1;
-        // TIMESTAMP (6 bits; 2 MSB dropped)
-        time_stamp = (stein_event >> (20 - (2+6))) & 63;
-        // DATA (12 bits; 4 lower bits dropped)
-        event_data = (stein_event >> (20 - (2+6+12))) & 4095;
-        break;
-    case 3: 
-        // ADD bit (1 bit; no bits dropped)
-        add =(stein_event >> (20 - (2+1))) & 1;
-        if (add == 0) { // EVCODE3 TYPE 1 (noise event)
-            // DET_ID bits (1 bit; 4 MSB dropped)
-            det_id = (stein_event >> (20 - (2+1+1))) & 1;
-            // TIMESTAMP (0 bits; all bits dropped)
-            time_stamp = -1;
-            // DATA (16 bits; no bits dropped)
-            event_data = stein_event & 65535L;
-        } else if (add == 1) {// EVCODE3 TYPE 2 (status event)
-            // DET_ID bits (0 bits; all bits dropped)
-            det_id = -1;
-            // TIMESTAMP (8 bits; no bits dropped)
-            time_stamp = (stein_event >> (20 - (2+1+8))) & 255;
-            // DATA (9 bits; 7 MSB dropped)
-            event_data = stein_event & 511;
-        } else {
-            cout << "Error! (INVALID ADD!)" << endl;
+            const uint8_t *end = data + len;
+            for (const uint8_t *line = data; line < end; ) {
+                const uint8_t *nl = (const uint8_t *)memchr(line, '\n', end - line);
+                size_t line_len = (nl ? nl : end) - line;
+                if (line_len > 1) {             // (blank lines hold no packet)
+                    HexLineScan scan = ScanHexLine((const char *)line, line_len,
+                                                   packet_bytes, packet_size);
+                    char reason [80];
+                    PacketIndexEntry entry;
+                    memset(&entry, 0, sizeof(entry));
+                    entry.offset = input.Offset() + (line - data);
+                    entry.line = n_lines;
+                    entry.time = last_time;
+                    if (validator.CheckPacket(scan, packet_bytes, reason) == PACKET_OK) {
+                        UnpackFrame(packet_bytes + ccsds_size + packetheader_size + timestamp_size,
+                                    events);
+                        entry.time = last_time
+                                   = PacketTime(packet_bytes + ccsds_size + packetheader_size);
+                        for (uint16_t i=0; i < event_cnt; i++) entry.counts[events.evcode[i] & 3]++;
+                    }
+                    index.Add(entry);
+                }
+                line += line_len + 1;
+                n_lines++;
+            }
+            input.Consume(len);
         }
-        break;
-    default:
-        cout << "Error! (INVALID EVCODE!)" << endl;
-        add = -1;
-        det_id = -1;
-        time_stamp = -1;
-        event_data = -1;
-      break; 
-   }
-
+        if (!more) break;
+    }
+    return true;
 }
 
 
-
 // procedure to read in and parse ASCII text dumps of CINEMA
 //      flight software output bytes
 int main(int argc, char *argv[]) {      
-    // optional command-line argument "filename"
-    char *fileName;
+    // optional command-line argument "filename", plus options
+    //   (see stein_options.h, PACKET VALIDATION / PACKET TIME in
+    //   stein_fsw.h, and PACKET INDEX above)
+    char *fileName = NULL;
+    vector<const char *> fileNames;     // (several, or a directory: batch run)
+    SteinOptions opts;
+    RunStats stats;                     // (--stats; see stein_stats.h)
+    bool build_index = false;
+    bool ranged = false;
+    PacketBound from = { false, 0 };
+    PacketBound to = { false, UINT64_MAX };
+    PacketChecks checks;
+    const char *quarantineName = NULL;
+    bool packet_time = false;
+    const char *housekeepingName = NULL;
+    const char *ratesName = NULL;
+    uint64_t rate_bin = 60 * packet_time_ticks;
 
     // parse command-line arguments
-    if (argc == 1){             // filename not specified; prompt user
-        // BROKEN - the user prompted contents of FILENAME fail to work
-        string receiver;        // initialize a string to receive input
+    for (int i=1; i < argc; i++) {
+        int used = ParseCommonOption(argc, argv, i, opts);
+        if (used < 0) return 1;                 // (malformed option)
+        if (used > 0) { i += used - 1; continue; }
+        if (strcmp(argv[i], "--build-index") == 0) {
+            build_index = true;
+            continue;
+        }
+        const char *value;
+        if ((value = OptionValue(argv[i], "--from")) || (value = OptionValue(argv[i], "--to"))) {
+            if (!ParsePacketBound(value, (argv[i][2] == 'f') ? from : to)) {
+                cerr << "invalid packet number / @time: " << value << "\n";
+                return 1;
+            }
+            ranged = true;
+            continue;
+        }
+        if ((value = OptionValue(argv[i], "--quarantine"))) {
+            quarantineName = value;
+            continue;
+        }
+        if ((value = OptionValue(argv[i], "--packet-tokens"))) {
+            char *end;
+            checks.n_tokens = strtoul(value, &end, 10);
+            if (*value < '0' || *value > '9' || *end != '\0' || checks.n_tokens < packet_size) {
+                cerr << "invalid token count (at least " << packet_size << "): " << value << "\n";
+                return 1;
+            }
+            continue;
+        }
+        if (strcmp(argv[i], "--check-spare") == 0) {
+            checks.zero_spare = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--packet-time") == 0) {
+            packet_time = true;
+            continue;
+        }
+        if ((value = OptionValue(argv[i], "--housekeeping"))) {
+            housekeepingName = value;
+            continue;
+        }
+        if ((value = OptionValue(argv[i], "--rates"))) {
+            ratesName = value;
+            continue;
+        }
+        if ((value = OptionValue(argv[i], "--rate-bin"))) {
+            char *end;
+            double seconds = strtod(value, &end);
+            if (*value < '0' || *value > '9' || *end != '\0' || !(seconds * packet_time_ticks >= 1)
+                    || seconds > 1e9) {
+                cerr << "invalid rate bin (seconds): " << value << "\n";
+                return 1;
+            }
+            rate_bin = (uint64_t)(seconds * packet_time_ticks + 0.5);
+            continue;
+        }
+        if (argv[i][0] == '-' && argv[i][1] != '\0') {
+            cerr << "unknown option: " << argv[i] << "\n";
+            return 1;
+        }
+        if (fileName == NULL) fileName = argv[i];
+        fileNames.push_back(argv[i]);
+    }
+    if ((ranged || build_index) && fileName && opts.decompress && DetectCompression(fileName)) {
+        cerr << "--build-index / --from / --to need an uncompressed data file\n";
+        return 1;
+    }
+    if (ranged && opts.follow) {
+        cerr << "--from / --to cannot be combined with --follow\n";
+        return 1;
+    }
+    if (packet_time && opts.format != FORMAT_TEXT) {
+        cerr << "--packet-time needs the ASCII event list (--format=text)\n";
+        return 1;
+    }
+
+    // batch run: many files, or a directory of them (see stein_batch.h)
+    if (fileNames.size() > 1 || (fileName && IsDirectory(fileName))) {
+        const char *why = BatchRun::Unsupported(opts);
+        if (!why && (ranged || build_index)) why = "--build-index / --from / --to take a single file";
+        if (!why && (quarantineName || housekeepingName || ratesName)) {
+            why = "--quarantine / --housekeeping / --rates take a single file";
+        }
+        if (why) {
+            cerr << "batch run: " << why << "\n";
+            return 1;
+        }
+        vector<BatchFile> files;
+        if (!ListBatchFiles(fileNames, files)) return 1;
+        FswPacketDecoder decoder(checks);
+        if (opts.filter.Active()) decoder.SetFilter(&opts.filter);
+        decoder.SetPacketInfo(packet_time || opts.format == FORMAT_COINCIDENCE
+                              || opts.window_ticks);
+        BatchRun batch(decoder, opts, "fsw_steinunpack");
+        batch.SetTimeColumn(packet_time);
+        return batch.Run(files, argv[0]) ? 1 : 0;
+    }
+
+    string receiver;            // initialize a string to receive input
+    if (fileName == NULL) {     // filename not specified; prompt user
         // prompt for a data file
         cout << "Welcome to STEIN_EXTRACT!  Please input file name: ";
         cin >> receiver;
-        // copy elements of string to char array
-        //char input[receiver.size() + 1];
-        //for (int i=0; i<receiver.size(); i++) {
-        //    input[i] = receiver[i];
-        //}
-        //input[receiver.size()] = '\0';
-        //fileName = &(input[0]);
-        char input[receiver.size() + 1];
-        //input = (receiver.c_str);
-        //cout << input;
-        //fileName = &(receiver.c_str[0]); //&(input[0]);
-        //cout << fileName << "|";
+        fileName = (char *)receiver.c_str();
         cout << "\n";
-    } else if (argc ==2 ) {     // argv[0] specified (assumed to be a filename)
-        cout << "# usage: " << argv[0] << " <data file>\n";
-        fileName = argv[1];
-        cout << "# " << fileName << "\n";
-    } // ignore any subsequent arguments
-
-    // initialize variables for data import
-    struct stat results;
-    unsigned int binary_len = 0;
+    }
 
-    // attempt to get file size, in bytes
-    if (stat(fileName, &results) == 0) {
-        // success; copy result to variable "binary_len"
-        binary_len = results.st_size;
-    } else {
-        // file open FAILED
-        cout << "Invalid file name / path: read failed!\n";
-        return 0;
+    // sidecar index: built on request, or when a range needs one and
+    //   there is no up-to-date index yet
+    PacketIndex index;
+    string indexName = IndexPath(fileName);
+    if (build_index || (ranged && !index.Open(indexName.c_str(), fileName))) {
+        PacketIndexWriter writer;
+        if (!BuildPacketIndex(fileName, checks, writer)
+                || !writer.Write(indexName.c_str(), fileName)) {
+            cerr << "cannot build packet index " << indexName << "\n";
+            return 1;
+        }
+        cerr << "# packet index: " << writer.NPackets() << " packets -> " << indexName << "\n";
+        if (!ranged) return 0;
+        if (!index.Open(indexName.c_str(), fileName)) {
+            cerr << "cannot read packet index " << indexName << "\n";
+            return 1;
+        }
     }
 
-    // helper variables
-    uint32_t line_cnt = 0L;
-    string ascii_line;          // temporary
-   
-    // open file to take a "peek" inside
-    ifstream asciiDataFile (fileName, ios::in); 
-    if (asciiDataFile.is_open()) {
-        while (asciiDataFile.good()) {
-            // read in a line, and see whether it is empty
-            getline(asciiDataFile,ascii_line);
+    // event-list output: ASCII text, or binary columns (--format=columnar)
+    cout.flush();
+    EventSink *output = MakeEventSink(opts);
+    if (packet_time) ((EventWriter *)output)->SetTimeColumn(true);
+    if (receiver.empty()) {     // filename given on the command line
+        output->Comment(("# usage: " + string(argv[0]) + " <data file>\n").c_str());
+        output->Comment(("# " + string(fileName) + "\n").c_str());
+    }
 
-            if (ascii_line.length() > 1) {
-                line_cnt++;
-                // cout << line_cnt << " " << ascii_line.length() << endl;
-            }   // else, blank line
-        }
-        cout << "# packet count (line_cnt): " << line_cnt << "\n";
-        asciiDataFile.close();
-    } else {
+    // open file for reading (mapped where possible; "-" is standard input,
+    //   and --follow reads a growing file as it is written; see stein_input.h)
+    InputSource input;
+    if (opts.follow) CatchStopSignals();        // (end --follow cleanly)
+    if (!input.Open(fileName, opts.follow, opts.decompress)) {
         // file open FAILED
+        output->Flush();
         cout << "Invalid file name / path: read failed!\n";
+        delete output;
         return 0;
     }
 
-    // DATA PACKET PARAMETERS
-    uint16_t    packet_size = 512;      // size (BYTES) of one packet of FSW data
-    // NOTE: the packet *usually* occupies 518-bytes; the CCSDS header has been stripped here
-    uint16_t    ccsds_size = 0;         // size (BYTES) of CCSDS header
-    // NOTE: the CCSDS header *usually* occupies 6-bytes; it has been stripped here
-    uint16_t    packetheader_size = 1;  // size (BYTES) of packet header (e.g. "0xAF" for STEIN)
-    uint16_t    timestamp_size = 6;     // size (BYTES) of packet timestamp
-    uint16_t    steinframe_size = 495;  // size (BYTES) of STEIN packet data subframe
-    uint16_t    housekeep_size = 8;     // size (BYTES) of packet housekeeping subframe
-    uint16_t    sparebyte_size = 2;     // size (BYTES) of packet unused bytes
-    // NOTE: the observed packet size is actually 514 bytes; the final 2 bytes are spurious
-    //
-    uint16_t    event_cnt = 198;       // size (# STEIN EVENTS) in one packet of FSW data
-   
-
-    // initialize storage arrays
-    // STEIN DATA TRANSMISSION SUBFRAME (and extracted quantities) 
-    uint32_t    n_events = (line_cnt * event_cnt);     // assumes that we have only STEIN packets
-    uint32_t    event_list [line_cnt][event_cnt];      // (for conversion to event-list)
-    int16_t      stein_evCode [line_cnt][event_cnt];    // max 2-bits
-    int16_t      stein_add [line_cnt][event_cnt];       // max 1-bit
-    int16_t      stein_detid [line_cnt][event_cnt];     // max 5-bits
-    int16_t     stein_timestamp [line_cnt][event_cnt]; // max 8-bits
-    int32_t     stein_eventdata [line_cnt][event_cnt]; // max 16-bits
-        // monolithic approach
-        //uint32_t    stein_data [6][n_events];
-        // *per-packet approach
-        //              ...quantity [line_cnt][event_cnt]
-        // event-list approach
-        //              ...quantity [n_events]
-    // 
-    // UNEXPLOITED QUANTITIES (extracted and stored, but not presently treated)
-    //uint8_t     packet_ccsds [ccsds_size][line_cnt];
-    // NOTE: CCSDS data is stripped out in pre-processing, hence this array is NOT FILLED
-    uint8_t     packet_header [line_cnt][packetheader_size];
-    uint8_t     packet_timestamp [line_cnt][timestamp_size];
-    // NOTE: STEIN_FRAME is broken down further
-    uint8_t     packet_housekeeping [line_cnt][housekeep_size];
-    // NOTE: spare bytes in each frame are disregarded
-
-
-    // helper variables (storage array indices)
-    uint32_t current_packet = 0L;       // tracks packet [line] number
-    uint32_t current_event = 0L;        // tracks absolute event number
+    uint64_t first_packet = 0, first_line = 0;
+    if (ranged) {
+        // seek straight to the packets [first, last) of the range; events
+        //   keep the frame numbers they have in the full event list
+        uint64_t n_packets = index.NPackets();
+        first_packet = ResolvePacketBound(index, from);
+        uint64_t last = ResolvePacketBound(index, to);
+        if (last < first_packet) last = first_packet;
+        uint64_t begin = (first_packet < n_packets) ? index.Entry(first_packet).offset : input.Size();
+        if (first_packet < n_packets) first_line = index.Entry(first_packet).line;
+        uint64_t end = (last < n_packets) ? index.Entry(last).offset : input.Size();
+        if (!input.SetRange(begin, end)) {
+            output->Flush();
+            cerr << "--from / --to need a regular, non-empty data file\n";
+            delete output;
+            return 1;
+        }
+        char range [80];
+        snprintf(range, sizeof(range), "# packets [%llu, %llu) of %llu\n",
+                 (unsigned long long)first_packet, (unsigned long long)last,
+                 (unsigned long long)n_packets);
+        output->Comment(range);
+    }
 
-    // open file for reading
-    asciiDataFile.open (fileName, ios::in); 
-    if (asciiDataFile.is_open()) {
-        cout << "# frame / EVCODE / ADD / DET_ID / TIME_STAMP / DATA\n"; 
-        while (asciiDataFile.good()) {
-            // 
-            // get one line
-            getline(asciiDataFile,ascii_line);  
-         
-            // does line contain data? 
-            if (ascii_line.length() > 1) { // yes, proceed to parse
-                //
-                // instantiate storage array for bytes in one packet
-                uint16_t packet_bytes [packet_size];     
+    // (text output goes through a large buffer, see stein_output.h,
+    //   which is only flushed when full or at the end of the run)
+    output->Header();
 
-                // HEX EXTRACT
-                // parse string by delimiter
-                vector<string> tokens;                          // instantiate receiver
-                Tokenize(ascii_line, tokens, " ");              // parse into elements
-                vector<string>::iterator i = tokens.begin();    // instantiate iterator
-                //
-                // loop over elements: trim and convert from ASCII to BYTE
-                for (uint16_t current_byte=0; current_byte < packet_size; current_byte++) {
-                    //   
-                    // (get length)
-                    unsigned int hexbyte_len = (*i).size();
-                    
-                    // extract the current ascii "hex byte"
-                    string ascii_hexbyte = (*i).substr(2, hexbyte_len-3);      
-                    
-                    // convert to BYTE and store
-                    char * cstr = new char [hexbyte_len-3];         // intermediate c_string
-                    strcpy (cstr, ascii_hexbyte.c_str());           // convert to c_string
-                    char * pEnd;
-                    packet_bytes[current_byte] = strtol(cstr,&pEnd,16);
-                    
-                    // increment vector iterator
-                    i++;
-                }
+    Quarantine quarantine;
+    if (quarantineName && !quarantine.Open(quarantineName)) {
+        output->Flush();
+        cerr << "cannot write " << quarantineName << "\n";
+        delete output;
+        return 1;
+    }
+    // per-packet time series (see stein_timeseries.h)
+    PacketSeries series;
+    const char *seriesName = NULL;
+    if (housekeepingName && !series.OpenHousekeeping(housekeepingName)) seriesName = housekeepingName;
+    if (ratesName && !series.OpenRates(ratesName, rate_bin)) seriesName = ratesName;
+    if (seriesName) {
+        output->Flush();
+        cerr << "cannot write " << seriesName << "\n";
+        delete output;
+        return 1;
+    }
+    FswPacketDecoder decoder(checks, &quarantine);
+    if (opts.filter.Active()) decoder.SetFilter(&opts.filter);
+    // (packets also mark the breaks in the data, for --coincidence, and
+    //   the time slices of --window=@S)
+    decoder.SetPacketInfo(packet_time || series.Active() || opts.format == FORMAT_COINCIDENCE
+                          || opts.window_ticks);
+    DecodePipeline pipeline(decoder, *output, opts.threads);
+    pipeline.SetFirstFrame(first_packet * event_cnt, first_line);
+    if (opts.stats) pipeline.SetStats(&stats);
+    if (series.Active()) pipeline.SetPacketSeries(&series);
+    uint64_t n_events = pipeline.Run(input);
+    chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    output->Finish();
+    bool output_failed = output->Failed();
+    delete output;
+    stats.output_seconds += StatSeconds(t0);
 
-                // HEX PARSE
-                //
-                uint16_t cursor = 0;            // byte-position cursor (for packet) 
-                // CCSDS (for usage, define "packet_ccsds" and set "ccsds_size" != 0)
-                //for (uint16_t i=0; i < ccsds_size; i++) {
-                //    packet_ccsds[current_packet][i] = packet_bytes[cursor];
-                //    cursor++;
-                //}
-                // PACKET HEADER
-                for (uint16_t i=0; i < packetheader_size; i++) {
-                    packet_header[current_packet][i] = packet_bytes[cursor];
-                    cursor++;
-                }
-                // PACKET TIMESTAMP
-                for (uint16_t i=0; i < timestamp_size; i++) {
-                    packet_timestamp[current_packet][i] = packet_bytes[cursor];
-                    cursor++;
-                }
-                // ***********
-                // STEIN DATA 
-                //
-                //
-                // NOTE: properly, this should be protected with if/else-statements
-                // temporary variable (for passing back and forth)
-                uint8_t stein_frame [steinframe_size];          // intermediate data storage
-                uint32_t event_log [event_cnt];                 // instantiate event_log
-                int16_t t_evcode, t_add, t_detid;               // temporary variables
-                int16_t t_timestamp;
-                int32_t t_eventdata;
-                //
-                // get STEIN bytes
-                for (uint16_t i=0; i < steinframe_size; i++) {
-                    stein_frame[i] = packet_bytes[cursor];      // copy out STEIN bytes
-                    cursor++;
-                }
-                // generate an events list from these bytes
-                ExtractEvents(stein_frame, event_log);          // extract events
-                
-                //Parse_EventReport(786688L, t_evcode, t_add, t_detid, t_timestamp, t_eventdata);
-                //
-                // parse each event into EVCODE, ADD, DETID, TIMESTAMP & EVENTDATA
-                for (uint16_t i=0; i < event_cnt; i++) {
-                    Parse_EventReport(event_log[i], t_evcode, t_add, t_detid, 
-                            t_timestamp, t_eventdata);
-                    // copy out to storage arrays 
-                    //event_list[current_packet][i]   = current_event; // (causes bus error) 
-                    stein_evCode[current_packet][i] = t_evcode; 
-                    stein_add[current_packet][i]    = t_add; 
-                    stein_detid[current_packet][i]  = t_detid; 
-                    stein_timestamp[current_packet][i] = t_timestamp; 
-                    stein_eventdata[current_packet][i] = t_eventdata; 
-                    
-                    cout << current_event << " " << t_evcode << " " << t_add << " " <<
-                        t_detid << " " << t_timestamp << " " << t_eventdata << endl;
-                    
-                    current_event++;
-                    cursor += steinframe_size;
-                }
-                //
-                // 
-                // ***********
-                // HOUSEKEEPING
-                for (uint16_t i=0; i < housekeep_size; i++) {
-                    packet_housekeeping[current_packet][i] = packet_bytes[cursor];
-                    cursor++;
-                }
-                // SPARE BYTES (UNIMPLEMENTED)
-                //
-            }
-            current_packet++;
-            
-        }
-        asciiDataFile.close();
-    } else {
+    // the packet count is only known once the stream is exhausted; report it
+    //   on stderr so the event list keeps its header-only comment block
+    cerr << "# packet count (line_cnt): " << n_events / event_cnt - first_packet << "\n";
+    if (uint64_t n_bad = quarantine.Count()) {
+        cerr << "# " << n_bad << " packets skipped (failed validation"
+             << (quarantineName ? string("; see ") + quarantineName : string()) << ")\n";
+    }
+    bool files_ok = true;               // (side files: quarantine, series)
+    if (!quarantine.Close()) {
+        cerr << "write to " << quarantineName << " failed\n";
+        files_ok = false;
+    }
+    if (!series.Finish()) {
+        cerr << "write to the housekeeping / rates file failed\n";
+        files_ok = false;
+    }
+    if (opts.stats && !stats.Write(opts.stats_file, "fsw_steinunpack", opts.threads)) {
+        files_ok = false;
     }
+    if (input.Failed()) {
+        cerr << "read of " << fileName << " failed (corrupt or truncated compressed data?)\n";
+        return 1;
+    }
+    if (output_failed) {
+        cerr << "write to standard out failed\n";
+        return 1;
+    }
+    if (!files_ok) return 1;
     return 0;
 }
-
-
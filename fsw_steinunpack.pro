@@ -164,6 +164,8 @@ END
 
 FUNCTION parse_eventreport, stein_event
 ; parses an individual STEIN event on the basis of EVCODE
+;  (field positions as described by the layouts in stein_layout.h,
+;  which the C++ decoders are generated from; keep the two in step)
 
     evCode = ISHFT(stein_event,-18)     ; upper 2 bits
     CASE evCode OF
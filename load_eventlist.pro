@@ -12,6 +12,18 @@
 ; USAGE:
 ;   < to be written >	
 ;
+;   Binary columnar event lists (written with "--format=columnar") are
+;   recognized by their "STEINCOL" header and read column-by-column with
+;   READ_COLUMNAR_EVENTLIST, without any text parsing.  Both return the
+;   same LonARR(6, n) layout; READ_COLUMNAR_EVENTLIST can instead return
+;   a structure of natively-typed columns (keyword /COLUMNS).
+;
+;   ASCII lists written with "--kev" carry a 7th (keV) column, and are
+;   returned as LonARR(7, n).  Lists written with "--packet-time" end in a
+;   PACKET_TIME column (seconds, with decimals), and are returned as
+;   DblARR instead; so are the "--housekeeping" and "--rates" tables of
+;   fsw_steinunpack (see "stein_timeseries.h"), which read the same way.
+;
 ; Copyright 2013 Karl Yando
 ;
 ; Licensed under the Apache License, Version 2.0 (the "License");
@@ -27,6 +39,71 @@
 ; limitations under the License.
 ;-
 
+FUNCTION IS_COLUMNAR_EVENTLIST, filename
+; true if FILENAME begins with the columnar event-list magic ("STEINCOL")
+    IF ~FILE_TEST(filename, /READ, /REGULAR) THEN RETURN, 0
+    IF (FILE_INFO(filename)).SIZE LT 8 THEN RETURN, 0
+    OPENR, /GET_LUN, unit, filename
+    magic = BytArr(8)
+    READU, unit, magic
+    FREE_LUN, unit
+    RETURN, STRING(magic) EQ 'STEINCOL'
+END
+
+
+FUNCTION READ_COLUMNAR_EVENTLIST, filename, COLUMNS=return_columns
+; reads a binary columnar event list (see "stein_columnar.h" for the
+;   layout); each column is read straight into an array of its stored type
+    OPENR, /GET_LUN, unit, filename, /SWAP_IF_BIG_ENDIAN
+
+    ; header
+    magic = BytArr(8)
+    version = 0UL & n_columns = 0UL & n_events = 0ULL
+    header_size = 0UL & align = 0UL
+    READU, unit, magic, version, n_columns, n_events, header_size, align
+    IF (STRING(magic) NE 'STEINCOL') OR (version NE 1) THEN BEGIN
+        Print, "ERROR (READ_COLUMNAR_EVENTLIST): not a version-1 columnar event list"
+        FREE_LUN, unit
+        RETURN, -1
+    ENDIF
+
+    ; column table (frame / EVCODE / ADD / DET_ID / TIMESTAMP / DATA)
+    entries = REPLICATE({NAME:BytArr(12), TYPE:0UL, OFFSET:0ULL, SIZE:0ULL}, n_columns)
+    READU, unit, entries
+
+    IF (n_events EQ 0) THEN BEGIN
+        Print, "READ_COLUMNAR_EVENTLIST: no events in " + filename
+        FREE_LUN, unit
+        RETURN, -1
+    ENDIF
+
+    data_frame = LonARR(n_columns, n_events)
+    FOR c=0, n_columns-1 DO BEGIN
+        CASE entries[c].type OF
+            '01'x: column = BytArr(n_events)
+            '02'x: column = UIntArr(n_events)
+            '04'x: column = ULonArr(n_events)
+            '08'x: column = ULon64Arr(n_events)
+            '11'x: column = BytArr(n_events)    ;(signed 8-bit; fixed below)
+            '12'x: column = IntArr(n_events)
+            '14'x: column = LonArr(n_events)
+            '18'x: column = Lon64Arr(n_events)
+        ENDCASE
+        POINT_LUN, unit, entries[c].offset
+        READU, unit, column
+        ; IDL has no signed byte type
+        IF (entries[c].type EQ '11'x) THEN column = FIX(column) - 256*(column GE 128)
+        data_frame[c, *] = column
+        IF (c EQ 0) THEN columns = CREATE_STRUCT(STRING(entries[c].name), column) $
+            ELSE columns = CREATE_STRUCT(columns, STRING(entries[c].name), column)
+    ENDFOR
+    FREE_LUN, unit
+
+    IF KEYWORD_SET(return_columns) THEN RETURN, columns
+    RETURN, data_frame
+END
+
+
 FUNCTION LOAD_EVENTLIST, filename
 ; instantiate variables
 data_file = ""
@@ -37,6 +114,10 @@ IF FILE_TEST(filename, /READ, /REGULAR) THEN BEGIN
     file_count = 1
 ENDIF ; else we can examine the contents of a directory, for instance
 
+; binary columnar event list?  (no need to parse any text)
+IF (file_count EQ 1) THEN $
+    IF IS_COLUMNAR_EVENTLIST(data_file) THEN RETURN, READ_COLUMNAR_EVENTLIST(data_file)
+
 ;FOR i=0, file_count-1 DO BEGIN
     OPENR, /GET_LUN, unit, data_file    ;[i]
     ; probably don't need to call FSTAT..
@@ -45,6 +126,8 @@ ENDIF ; else we can examine the contents of a directory, for instance
     comment_marker = '#'
     start_position = 0L
     data_count = 0L
+    n_columns = 6                       ;(7 with a "--kev" column)
+    decimals = 0                        ;(e.g. a "--packet-time" column)
     str=""
 
     ; peruse contents (no copy)
@@ -55,7 +138,14 @@ ENDIF ; else we can examine the contents of a directory, for instance
             POINT_LUN, -unit, byteID    ;(get byteID)
             start_position = byteID     ;(store byteID)
             ; we can skip straight to the end of this line now
-        ENDIF ELSE ++data_count         ;(increment data_count)
+        ENDIF ELSE BEGIN
+            ; (count the columns of the first record)
+            IF (data_count EQ 0) THEN BEGIN
+                n_columns = N_ELEMENTS(STRSPLIT(str, /EXTRACT))
+                decimals = (STRPOS(str, '.') GE 0)
+            ENDIF
+            ++data_count                ;(increment data_count)
+        ENDELSE
     ENDWHILE
 
     ; instantiate our data array
@@ -63,7 +153,8 @@ ENDIF ; else we can examine the contents of a directory, for instance
     
     ; copy in data
     POINT_LUN, unit, start_position
-    data_frame = LonARR(6,data_count)
+    IF decimals THEN data_frame = DblARR(n_columns,data_count) $
+        ELSE data_frame = LonARR(n_columns,data_count)
     READF, unit, data_frame
 
     ; free lun
@@ -10,7 +10,18 @@
 //  output file, to which an ASCII event list will be written.
 //
 // (see usage notes in sub20_to_binary.py, if conversion from raw dump 
-//   to packed binary is needed)
+//   to packed binary is needed; or use "--sub20", below)
+//
+// With "--simulate-fsw", EVCODE 0 events come out as the flight software
+//  would have sent them (7-bit log-binned DATA; see RawRecordDecoder),
+//  and "--kev" adds the matching keV column:
+//
+//    ./raw_steinunpack --simulate-fsw --kev STEIN_RAWBYTESLOG.log > SIMFSW.txt
+//
+// SUB-20 log text ("80 00 00 00   | ....") is read directly with "--sub20",
+//  optionally saving the packed binary alongside ("--write-binary=FILE"):
+//
+//    ./raw_steinunpack --sub20 log.log > STEINBYTESLOG.txt
 //
 //
 // Copyright 2013 Karl Yando
@@ -31,159 +42,239 @@
 #include <fstream>
 #include <iostream>
 #include <string>
+#include <vector>
+#include <fcntl.h>
 #include <sys/stat.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
 using namespace std;
 
-// from <http://c-faq.com/misc/hexio.html>
-char *baseconv(unsigned int num, int base) {
-    static char retbuf[33];
-    char *p;
-
-    if(base < 2 || base > 16)
-        return NULL;
+#include "stein_batch.h"
+#include "stein_hexparse.h"
+#include "stein_input.h"
+#include "stein_layout.h"
+#include "stein_output.h"
+#include "stein_options.h"
+#include "stein_pipeline.h"
+#include "stein_raw.h"
+#include "stein_stats.h"
 
-    p = &retbuf[sizeof(retbuf)-1];
-    *p = '\0';
 
-    do {
-        *--p = "0123456789abcdef"[num % base];
-        num /= base;
-    } while(num != 0);
+// SUB-20 INPUT ("--sub20")
+// SUB-20 log text is packed into 32-bit records on the main thread, one
+//   chunk of whole lines at a time, and the records then go through the
+//   usual raw pipeline -- no intermediate file, no sub20_to_binary.py.
+//   With "--write-binary=FILE" the same records are also saved to FILE,
+//   byte for byte as sub20_to_binary.write_sub20_hexbytes() wrote them.
+//   Returns the number of lines that were neither blank nor a record.
+static uint64_t PackSub20(const uint8_t *text, size_t len, vector<uint8_t> &packed) {
+    const uint8_t *end = text + len;
+    uint64_t n_bad = 0;
+    uint8_t record [record_size];
 
-    return p;
+    packed.clear();
+    while (text < end) {
+        const uint8_t *nl = (const uint8_t *)memchr(text, '\n', end - text);
+        size_t line_len = (nl ? nl : end) - text;
+        int found = ParseSub20Line((const char *)text, line_len, record);
+        if (found > 0) packed.insert(packed.end(), record, record + record_size);
+        else if (found < 0) n_bad++;
+        text += line_len + 1;
+    }
+    return n_bad;
 }
 
 
 int main(int argc, char *argv[]) {      
-    // optional command-line argument "filename"
-    char *fileName;
+    // optional command-line argument "filename", plus options
+    //   (see stein_options.h, and --simulate-fsw / --sub20 above)
+    char *fileName = NULL;
+    vector<const char *> fileNames;     // (several, or a directory: batch run)
+    SteinOptions opts;
+    RunStats stats;                     // (--stats; see stein_stats.h)
+    bool simulate_fsw = false;
+    bool sub20 = false;
+    const char *binaryName = NULL;      // (--write-binary)
 
     // parse command-line arguments
-    if (argc == 1){             // filename not specified; prompt user
-        // BROKEN - the user prompted contents of FILENAME fail to work
-        string receiver;        // initialize a string to receive input
+    for (int i=1; i < argc; i++) {
+        int used = ParseCommonOption(argc, argv, i, opts);
+        if (used < 0) return 1;                 // (malformed option)
+        if (used > 0) { i += used - 1; continue; }
+        if (strcmp(argv[i], "--simulate-fsw") == 0) {
+            simulate_fsw = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--sub20") == 0) {
+            sub20 = true;
+            continue;
+        }
+        if (const char *value = OptionValue(argv[i], "--write-binary")) {
+            binaryName = value;
+            continue;
+        }
+        if (argv[i][0] == '-' && argv[i][1] != '\0') {
+            cerr << "unknown option: " << argv[i] << "\n";
+            return 1;
+        }
+        if (fileName == NULL) fileName = argv[i];
+        fileNames.push_back(argv[i]);
+    }
+    if (binaryName && !sub20) {
+        cerr << "--write-binary needs --sub20 input\n";
+        return 1;
+    }
+    if (opts.window_ticks) {
+        cerr << "--window=@S needs FSW packet times; raw data takes --window=N (frames)\n";
+        return 1;
+    }
+    // (EVCODE 0 TIME_STAMPs, for --coincidence)
+    opts.stamp_period = simulate_fsw ? FswEvcode0::time_stamp::mask + 1
+                                     : RawLayout::time_stamp::mask + 1;
+
+    // batch run: many files, or a directory of them (see stein_batch.h)
+    if (fileNames.size() > 1 || (fileName && IsDirectory(fileName))) {
+        const char *why = BatchRun::Unsupported(opts);
+        if (!why && sub20) why = "--sub20 takes a single file";
+        if (why) {
+            cerr << "batch run: " << why << "\n";
+            return 1;
+        }
+        vector<BatchFile> files;
+        if (!ListBatchFiles(fileNames, files)) return 1;
+        RawRecordDecoder decoder(simulate_fsw);
+        if (opts.filter.Active()) decoder.SetFilter(&opts.filter);
+        BatchRun batch(decoder, opts, "rawstein_extract");
+        return batch.Run(files, argv[0]) ? 1 : 0;
+    }
+
+    string receiver;            // initialize a string to receive input
+    if (fileName == NULL) {     // filename not specified; prompt user
         // prompt for a data file
         cout << "Welcome to STEIN_EXTRACT!  Please input file name: ";
         cin >> receiver;
-        // copy elements of string to char array
-        //char input[receiver.size() + 1];
-        //for (int i=0; i<receiver.size(); i++) {
-        //    input[i] = receiver[i];
-        //}
-        //input[receiver.size()] = '\0';
-        //fileName = &(input[0]);
-        char input[receiver.size() + 1];
-        //input = (receiver.c_str);
-        //cout << input;
-        //fileName = &(receiver.c_str[0]); //&(input[0]);
-        //cout << fileName << "|";
+        fileName = (char *)receiver.c_str();
         cout << "\n";
-    } else if (argc ==2 ) {     // argv[0] specified (assumed to be a filename)
-        cout << "# usage: " << argv[0] << " <data file>\n";
-        fileName = argv[1];
-        cout << "# " << fileName << "\n";
-    } // ignore any subsequent arguments
+    }
 
+    // event-list output: ASCII text, or binary columns (--format=columnar)
+    cout.flush();
+    EventSink *output = MakeEventSink(opts);
+    if (receiver.empty()) {     // filename given on the command line
+        output->Comment(("# usage: " + string(argv[0]) + " <data file>\n").c_str());
+        output->Comment(("# " + string(fileName) + "\n").c_str());
+    }
 
-    // initialize variables for data import
-    struct stat results;
-    uint32_t binary_len = 0;
 
-    // attempt to get file size, in bytes
-    if (stat(fileName, &results) == 0) {
-        // success; copy result to variable "binary_len"
-        binary_len = results.st_size;
-    } else {
+    // open the input: regular files are memory-mapped and decoded straight
+    //   from the mapped pages (no copy); pipes, standard input ("-") and
+    //   followed files (--follow) are read in chunks as data arrives
+    InputSource input;
+    if (opts.follow) CatchStopSignals();        // (end --follow cleanly)
+    if (!input.Open(fileName, opts.follow, opts.decompress)) {
         // file open FAILED
+        output->Flush();
         cout << "Invalid file name / path: read failed!\n";
+        delete output;
         return 0;
     }
+    if (input.IsMapped()) {
+        char note [64];
+        snprintf(note, sizeof(note), "# Import successful; bytes read: %llu\n",
+                 (unsigned long long)input.Size());
+        output->Comment(note);
+    }
 
-    // initialize storage array
-    char * binary_data;
-    binary_data = new char [binary_len];
-    
-    // open file for reading
-    ifstream binaryDataFile (fileName, ios::in | ios::binary);
-    // begin reading
-    binaryDataFile.read(binary_data,binary_len);
-    
-    if (!binaryDataFile) {
-        // error has occured in reading
-        cout << "error during read! \n";
-        delete[] binary_data;   // relinquish claimed memory
-        binaryDataFile.close(); // close file
-        return 0;
+    // *not necessary* to open a specific file, as we use standard out;
+    //   text output goes through a large buffer (see stein_output.h),
+    //   which is only flushed when full or at the end of the run
+    // write ourselves a header
+    output->Header();
+
+    // optional packed-binary copy of SUB-20 input
+    int binary_fd = -1;
+    bool binary_failed = false;
+    if (binaryName) {
+        binary_fd = open(binaryName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (binary_fd < 0) {
+            output->Flush();
+            cerr << "cannot write " << binaryName << "\n";
+            delete output;
+            return 1;
+        }
+    }
+
+    // primary loop (whole records at a time; see stein_pipeline.h)
+    RawRecordDecoder decoder(simulate_fsw);
+    if (opts.filter.Active()) decoder.SetFilter(&opts.filter);
+    DecodePipeline pipeline(decoder, *output, opts.threads);
+    if (opts.stats) pipeline.SetStats(&stats);
+    if (!sub20) {
+        pipeline.Run(input);
+        // (any trailing partial record is ignored, as before)
     } else {
-        cout << "# Import successful; bytes read: ";
-        cout << binaryDataFile.gcount() << "\n";
-        binaryDataFile.close(); // close file
+        vector<uint8_t> packed;
+        uint64_t n_bad = 0;
+        bool binary_ok = true;
+        while (true) {
+            chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+            bool more = input.Fill();
+            stats.read_seconds += StatSeconds(t0);
+            bool at_eof = !more && !input.Stopped();
+            while (input.Available()) {
+                size_t len = LineChunkLength(input.Data(), input.Available(),
+                                             DecodePipeline::chunk_size, at_eof);
+                if (len == 0) break;            // (need more input)
+                t0 = chrono::steady_clock::now();
+                n_bad += PackSub20(input.Data(), len, packed);
+                stats.decode_seconds += StatSeconds(t0);
+                input.Consume(len);
+                stats.bytes_read += len;
+                if (packed.empty()) continue;
+                if (binary_fd >= 0 && binary_ok) {
+                    binary_ok = WriteAll(binary_fd, &packed[0], packed.size());
+                }
+                pipeline.Submit(&packed[0], packed.size(), false);
+            }
+            if (!more) break;
+            if (input.Idle()) {                 // (--follow)
+                pipeline.Flush();
+                input.Wait();
+            }
+        }
+        pipeline.Drain();
+        stats.counts.bad_sub20_line += n_bad;
+        if (n_bad) cerr << "# SUB-20: " << n_bad << " lines skipped (not 4 hex bytes)\n";
+        if (binary_fd >= 0 && (close(binary_fd) != 0 || !binary_ok)) {
+            cerr << "write to " << binaryName << " failed\n";
+            binary_failed = true;
+        }
     }
-    
 
-    // 32-bit data packets, so each packet is actually spread across four CHAR bytes (8 hex characters)
-    
-    // conversion from signed to unsigned bytes
-    unsigned char * raw;
-    raw = new unsigned char [binary_len];
-    for (uint32_t i=0L; i<binary_len; i++) {
-       raw[i] = (unsigned char)(binary_data[i]);
-    } 
-    // operation complete
-    
-    // we've now copied over the contents of "binary_data",
-    //   so we can relinquish that memory 
-    delete[] binary_data;
-   
-    // with very large datafiles, if we attempt to hold variable arrays
-    //   in memory, then we appear to *run out* of allocatable memory,
-    //   and begin to incur memory errors and seg faults
-    // to avoid this situation, we can print out the variable values
-    //   as they are processed, which should hugely reduce memory usage
-    unsigned long n_frames = binary_len/4L;
-    unsigned char evcode;
-    unsigned char add;
-    unsigned char det_id;
-    unsigned char timestamp;
-    unsigned short data;  
-        // NOTE: STEIN data is properly interpreted as a *signed* 16-bit int
-
-    // *not necessary* to open a specific file, as we use standard out
-    // write ourselves a header
-    cout << "# frame / EVCODE / ADD / DET_ID / TIME_STAMP / DATA\n"; 
-
-    // primary loop
-    for (uint32_t i=0L; i < n_frames; i++) {
-        // EVCODE(1:0) [1st CHAR]
-        evcode = (raw[4L*i] >> 6) & 0xff  ; 
-        // ADD(0) [1st CHAR]
-        add = (raw[4L*i] >> 5) - (evcode << 1); 
-        // DET ID(4:0) [1st CHAR]
-        det_id = raw[4L*i]  - ((raw[4L*i] >> 5) << 5); 
-        // TIME STAMP(7:0) [2nd CHAR]
-        timestamp = raw[4L*i+1L];
-        // DATA(15:0) [3rd + 4th CHARs]
-        data = (raw[4L*i + 2L] << 8) + (raw[4L*i + 3L]);
-
-        // manual "shift", to take us from a (misinterpreted) 
-        //   signed value to a *true* unsigned value
-        data = (data + 32768);  // (type is UINT16, so rolls over at 2L^16)
-
-        // write out results 
-        cout << i << " ";
-        cout << baseconv(evcode,10) << " ";
-        cout << baseconv(add,10) << " "; 
-        cout << baseconv(det_id,10) << " ";
-        cout << baseconv(timestamp,10) << " "; 
-        cout << baseconv(data, 10) << endl;
+    // a streamed input's size is only known at the end; report it on
+    //   stderr so the event list keeps its header-only comment block
+    chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    output->Finish();
+    bool output_failed = output->Failed();
+    delete output;
+    stats.output_seconds += StatSeconds(t0);
+    if (!input.IsMapped()) {
+        cerr << "# Import successful; bytes read: " << input.Offset() + input.Available() << "\n";
     }
-    
-    // input file already closed - nothing to do
-    // manually free up allocated memory (necessary?)
-    delete[] raw;
+    if (opts.stats && !stats.Write(opts.stats_file, "rawstein_extract", opts.threads)) {
+        return 1;
+    }
+    if (input.Failed()) {
+        cerr << "read of " << fileName << " failed (corrupt or truncated compressed data?)\n";
+        return 1;
+    }
+    if (output_failed) {
+        cerr << "write to standard out failed\n";
+        return 1;
+    }
+    if (binary_failed) return 1;                // (reported above)
     
     // done
     return 0;
 }
-
-
@@ -0,0 +1,126 @@
+;+
+; READ_STEIN_EVENTS
+;
+; AUTHOR:
+;	Karl Yando
+;
+; PURPOSE:
+;  IDL code that decodes a STEIN data file in memory, through libstein
+;    (the decoders of "fsw_steinunpack.cpp" and "rawstein_extract.cpp" as
+;    a shared library; see "stein_capi.h"), and returns its event list as
+;    LOAD_EVENTLIST would have read it from the ASCII output: no event
+;    list is written, and no text is parsed.
+;
+; USAGE:
+;   events = READ_STEIN_EVENTS('STEINBYTESLOG.log')              ; FSW dump
+;   events = READ_STEIN_EVENTS('STEIN_RAWBYTESLOG.log', FORMAT='raw')
+;   events = READ_STEIN_EVENTS('STEINBYTESLOG.log', THREADS=4, /COLUMNS)
+;
+;   FORMAT is 'fsw' (default), 'raw', or 'raw-simfsw' (raw data as with
+;   "--simulate-fsw").  Returns LonARR(6, n) (frame / EVCODE / ADD /
+;   DET_ID / TIMESTAMP / DATA), or with /COLUMNS a structure of one array
+;   per column (FRAME as LONG64), plus PACKET_TIME (seconds since January
+;   1, DOUBLE) for FSW dumps.  Returns -1 if the file cannot be read, or
+;   holds no events.
+;
+;   The library is libstein.so beside this file, or $STEIN_LIBRARY, or
+;   LIBRARY='path'; build it with
+;     g++ -O2 -shared -fPIC -fvisibility=hidden -pthread -o libstein.so stein_capi.cpp
+;
+; Copyright 2013 Karl Yando
+;
+; Licensed under the Apache License, Version 2.0 (the "License");
+; you may not use this file except in compliance with the License.
+; You may obtain a copy of the License at
+;
+; http://www.apache.org/licenses/LICENSE-2.0
+;
+; Unless required by applicable law or agreed to in writing, software
+; distributed under the License is distributed on an "AS IS" BASIS,
+; WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+; See the License for the specific language governing permissions and
+; limitations under the License.
+;-
+
+FUNCTION STEIN_LIBRARY_PATH
+; libstein.so: $STEIN_LIBRARY, else next to this file
+    path = GETENV('STEIN_LIBRARY')
+    IF (path NE '') THEN RETURN, path
+    source = ROUTINE_INFO('READ_STEIN_EVENTS', /FUNCTIONS, /SOURCE)
+    RETURN, FILEPATH('libstein.so', ROOT_DIR=FILE_DIRNAME(source.path))
+END
+
+
+FUNCTION READ_STEIN_EVENTS, filename, FORMAT=format, THREADS=threads, $
+                            LIBRARY=library, COLUMNS=return_columns
+    IF ~KEYWORD_SET(format) THEN format = 'fsw'
+    IF ~KEYWORD_SET(threads) THEN threads = 1
+    IF ~KEYWORD_SET(library) THEN library = STEIN_LIBRARY_PATH()
+    format_code = (WHERE(['fsw', 'raw', 'raw-simfsw'] EQ STRLOWCASE(format)))[0]
+    IF (format_code LT 0) THEN BEGIN
+        Print, "ERROR (READ_STEIN_EVENTS): unknown FORMAT " + format
+        RETURN, -1
+    ENDIF
+
+    ; open (the path goes by value, i.e. as a C string)
+    handle = CALL_EXTERNAL(library, 'stein_idl_open', STRING(filename), LONG(format_code), $
+                           LONG(threads), VALUE=[1,0,0], /L64_VALUE)
+    IF (handle EQ 0) THEN BEGIN
+        Print, "ERROR (READ_STEIN_EVENTS): cannot read " + filename
+        RETURN, -1
+    ENDIF
+
+    ; decode in batches (one array per column), kept until the end
+    batch_size = 1048576LL
+    batches = PTRARR(16)
+    n_batches = 0L
+    n_events = 0LL
+    WHILE 1 DO BEGIN
+        frame = Lon64Arr(batch_size)
+        evcode = LonArr(batch_size) & add = LonArr(batch_size)
+        det_id = LonArr(batch_size) & time_stamp = LonArr(batch_size)
+        data = LonArr(batch_size) & packet_time = ULon64Arr(batch_size)
+        n = CALL_EXTERNAL(library, 'stein_idl_read', handle, batch_size, frame, evcode, add, $
+                          det_id, time_stamp, data, packet_time, /L64_VALUE)
+        IF (n LE 0) THEN BREAK
+        IF (n_batches EQ N_ELEMENTS(batches)) THEN batches = [batches, PTRARR(n_batches)]
+        batches[n_batches++] = PTR_NEW({frame:frame[0:n-1], evcode:evcode[0:n-1], $
+            add:add[0:n-1], det_id:det_id[0:n-1], time_stamp:time_stamp[0:n-1], $
+            data:data[0:n-1], packet_time:packet_time[0:n-1]}, /NO_COPY)
+        n_events += n
+    ENDWHILE
+    IF (n LT 0) THEN $
+        Print, "ERROR (READ_STEIN_EVENTS): " + $
+            CALL_EXTERNAL(library, 'stein_idl_error', handle, /S_VALUE)
+    status = CALL_EXTERNAL(library, 'stein_idl_close', handle, /L64_VALUE)
+
+    IF (n LT 0) OR (n_events EQ 0) THEN BEGIN
+        IF (n_batches GT 0) THEN PTR_FREE, batches[0:n_batches-1]
+        IF (n_events EQ 0) THEN Print, "READ_STEIN_EVENTS: no events in " + filename
+        RETURN, -1
+    ENDIF
+
+    ; join the batches (packet times in seconds)
+    ticks = CALL_EXTERNAL(library, 'stein_idl_packet_time_ticks', /L64_VALUE)
+    columns = {frame:Lon64Arr(n_events), evcode:LonArr(n_events), add:LonArr(n_events), $
+               det_id:LonArr(n_events), time_stamp:LonArr(n_events), data:LonArr(n_events), $
+               packet_time:DblArr(n_events)}
+    at = 0LL
+    FOR b=0L, n_batches-1 DO BEGIN
+        n = N_ELEMENTS((*batches[b]).frame)
+        FOR c=0, 5 DO columns.(c)[at:at+n-1] = (*batches[b]).(c)
+        columns.packet_time[at:at+n-1] = (*batches[b]).packet_time / DOUBLE(ticks)
+        at += n
+    ENDFOR
+    PTR_FREE, batches[0:n_batches-1]
+
+    IF KEYWORD_SET(return_columns) THEN BEGIN
+        IF (format_code NE 0) THEN RETURN, {frame:columns.frame, evcode:columns.evcode, $
+            add:columns.add, det_id:columns.det_id, time_stamp:columns.time_stamp, $
+            data:columns.data}
+        RETURN, columns
+    ENDIF
+    data_frame = LonArr(6, n_events)
+    FOR c=0, 5 DO data_frame[c, *] = columns.(c)
+    RETURN, data_frame
+END
@@ -41,6 +41,9 @@ PRO EX_PLOT_RAW, XRANGE=x__range, YRANGE=y__range, XTITLE=x__title, YTITLE=y__ti
     
     ; this RAW spectrum is great, but we want to make sure our software is working correctly:
     ;  Simulate what FSW should be doing, and create a "processed RAW" dataset
+    ;  (rawstein_extract --simulate-fsw [--kev] does this while decoding, but
+    ;   applies the sign fix below once, to DATA as decoded; the extra
+    ;   "+ 2L^15" this script adds to rawstein output is not reproduced)
     ; copy the array "RAW_eventlist", so we can edit it
     processed_raw = raw_eventlist
     IF (simulate_fsw) THEN BEGIN
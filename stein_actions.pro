@@ -14,6 +14,10 @@
 ;
 ;   (function) HISTOGRAM_DATA: wrapper for IDL's "HISTOGRAM" function.
 ;
+;   (function) SPECTRUM_FROM_TABLE: the full-size spectrum of one EV_CODE /
+;       ADD / DET_ID from a "--histogram" table written by the C++ tools
+;       (read with LOAD_EVENTLIST), without another pass over an event list.
+;
 ;   (procedure) PLOT_HISTOGRAM: convenience procedure that allows user to 
 ;       specify desired values of EV_CODE, ADD, and DET_ID, and easily
 ;       generate a histogram plot via IDL's "OPLOT" procedure (NOTE: 
@@ -53,6 +57,8 @@ END
 
 FUNCTION GET_SUBSET, data, evcode, add, det_id
 ; (negative values for "evcode / add / det_id" cause us to skip that filter) 
+; (the C++ tools can apply the same filter while decoding, e.g.
+;   "--evcode=0 --det-id=5", so the subset is all that gets loaded)
 ; requires arguments EVCODE, ADD, DET_ID to be of type SCALAR INTEGER
 ; returns BOOLEAN ARRAY 
     
@@ -97,6 +103,27 @@ FUNCTION HISTOGRAM_DATA, data, INDICES=data_index, FULLSIZE=full_histsize
     RETURN, fullHistogram
 END
 
+FUNCTION SPECTRUM_FROM_TABLE, table, evcode, add, det_id, WINDOW=window_frame, FULLSIZE=full_histsize
+    ;(SPECTRUM_FROM_TABLE): requires argv[0] TABLE, as read by LOAD_EVENTLIST
+    ;   from "--histogram" output (window / EVCODE / ADD / DET_ID / DATA / COUNT);
+    ;   negative values for "evcode / add / det_id" sum over that column, as
+    ;   in GET_SUBSET.  WINDOW selects one time slice (default: all of them).
+    IF ~KEYWORD_SET(full_histsize) THEN full_histsize = 2L^16 ELSE $
+        IF (full_histsize[0] LE 0) THEN full_histsize = 2L^16
+
+    ; (the table's first five columns line up with GET_SUBSET's)
+    match = GET_SUBSET(table, evcode, add, det_id)
+    IF (N_ELEMENTS(window_frame) GT 0) THEN match = match * (table[0,*] EQ window_frame[0])
+    match = match * (table[4,*] LT full_histsize)
+
+    spectrum = ULon64Arr(full_histsize)
+    rows = WHERE(match, row_cnt)
+    FOR i=0L, row_cnt-1 DO $
+        spectrum[table[4,rows[i]]] = spectrum[table[4,rows[i]]] + table[5,rows[i]]
+
+    RETURN, spectrum
+END
+
 PRO PLOT_HISTOGRAM, data, EVCODE=ev_code, ADD=add, DET_IDINDEX=det_id_index, TALLYFLAG = tally_flag, PSYMINDEX = psym_index, COLORINDEX = color_index, FULLSIZE=full_histsize, _REF_EXTRA = pass_thru
    ; WORKZONE 
     ; process and safe EVCODE, ADD, and DET_ID[INDEX] keywords
@@ -0,0 +1,330 @@
+//
+// stein_batch.h -- batch runs of fsw_steinunpack and rawstein_extract: many
+//  data files, or whole directories of them, decoded in one command.
+//
+//    ./fsw_steinunpack -j 8 --histogram campaign/ > campaign_spectra.txt
+//    ./rawstein_extract -j 8 --output-dir=lists/ run1.log run2.log run3.log
+//
+// A run becomes a batch when it is given more than one data file, or a
+//  directory (its regular files, in name order; hidden files and ".idx"
+//  packet indexes are skipped).  Files are started largest first, each on
+//  a thread of one work-stealing TaskPool (stein_pipeline.h); the chunks of
+//  a file are decoded by whichever threads are free, so a few huge files
+//  do not leave the other threads idle once the small ones are done.
+//  Every file is numbered from frame 0, as in a run of its own.
+//
+// Outputs:
+//    --output-dir=DIR    one output per file, DIR/<file name> plus ".txt"
+//                        (event list), ".col" (--format=columnar),
+//                        ".hist.txt" (--histogram) or ".coinc.txt"
+//                        (--coincidence), each holding what a single-file
+//                        run would write
+//    (default)           one merged stream on standard out.  The ASCII
+//                        event list gets a SOURCE column, the input's
+//                        number in the "# source N: FILE" lines at the top;
+//                        blocks of lines from different files interleave.
+//                        With --histogram, the spectra of all files are
+//                        summed into one table, and with --coincidence
+//                        the matrices (no hit pairs with one of another
+//                        file).
+//
+// A columnar event list, --histogram with --window, and
+//  --coincidence-groups need --output-dir.
+//  "# FILE: N frames" is written to stderr as each file finishes; with
+//  --stats, the summary covers the whole batch.
+//
+//
+// Copyright 2013 Karl Yando
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef STEIN_BATCH_H
+#define STEIN_BATCH_H
+
+#include <algorithm>
+#include <atomic>
+#include <dirent.h>
+#include <fcntl.h>
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <string.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "stein_histogram.h"
+#include "stein_input.h"
+#include "stein_options.h"
+#include "stein_output.h"
+#include "stein_pipeline.h"
+#include "stein_stats.h"
+
+struct BatchFile {
+    std::string path;
+    uint64_t    size;
+};
+
+// true if "path" names a directory
+inline bool IsDirectory(const char *path) {
+    struct stat results;
+    return stat(path, &results) == 0 && S_ISDIR(results.st_mode);
+}
+
+// the data files named by "names" (files, or directories of them), in
+//   order; returns false (after a message on stderr) if any cannot be read
+inline bool ListBatchFiles(const std::vector<const char *> &names, std::vector<BatchFile> &files) {
+    for (size_t i=0; i < names.size(); i++) {
+        struct stat results;
+        if (stat(names[i], &results) != 0) {
+            fprintf(stderr, "cannot read %s\n", names[i]);
+            return false;
+        }
+        if (!S_ISDIR(results.st_mode)) {
+            BatchFile f = { names[i], (uint64_t)results.st_size };
+            files.push_back(f);
+            continue;
+        }
+        DIR *dir = opendir(names[i]);
+        if (!dir) {
+            fprintf(stderr, "cannot read directory %s\n", names[i]);
+            return false;
+        }
+        std::vector<std::string> entries;
+        while (struct dirent *entry = readdir(dir)) {
+            size_t n = strlen(entry->d_name);
+            if (entry->d_name[0] == '.') continue;
+            if (n > 4 && strcmp(entry->d_name + n - 4, ".idx") == 0) continue;
+            entries.push_back(entry->d_name);
+        }
+        closedir(dir);
+        std::sort(entries.begin(), entries.end());
+        std::string prefix = names[i];
+        if (prefix[prefix.size() - 1] != '/') prefix += '/';
+        for (size_t k=0; k < entries.size(); k++) {
+            std::string path = prefix + entries[k];
+            if (stat(path.c_str(), &results) != 0 || !S_ISREG(results.st_mode)) continue;
+            BatchFile f = { path, (uint64_t)results.st_size };
+            files.push_back(f);
+        }
+    }
+    return true;
+}
+
+// the output file of "path" in --output-dir "dir"
+inline std::string BatchOutputPath(const char *dir, const std::string &path, OutputFormat format) {
+    size_t slash = path.rfind('/');
+    std::string name = (slash == std::string::npos) ? path : path.substr(slash + 1);
+    std::string out = dir;
+    if (out[out.size() - 1] != '/') out += '/';
+    out += name;
+    if (format == FORMAT_COLUMNAR) return out + ".col";
+    if (format == FORMAT_HISTOGRAM) return out + ".hist.txt";
+    if (format == FORMAT_COINCIDENCE) return out + ".coinc.txt";
+    return out + ".txt";
+}
+
+
+class BatchRun {
+public:
+    // "decoder" is shared by every thread (Decode() is const); "tool" names
+    //   the program in messages and --stats
+    BatchRun(const ChunkDecoder &decoder, const SteinOptions &opts, const char *tool)
+        : decoder(decoder), opts(opts), tool(tool), time_column(false), merged(NULL),
+          stats(NULL), usage(NULL), n_failed(0) {}
+
+    // ASCII event lists get a PACKET_TIME column (fsw_steinunpack)
+    void SetTimeColumn(bool on) { time_column = on; }
+
+    // options a batch cannot honour; returns a message, or NULL
+    static const char *Unsupported(const SteinOptions &opts) {
+        if (opts.follow) return "--follow reads a single input";
+        if (opts.output_dir) return NULL;
+        if (opts.format == FORMAT_COLUMNAR) return "a merged batch cannot be columnar; use --output-dir";
+        if (opts.format == FORMAT_HISTOGRAM && (opts.window || opts.window_ticks)) {
+            return "a merged batch sums whole files; --window needs --output-dir";
+        }
+        if (opts.format == FORMAT_COINCIDENCE && opts.coincidence_groups) {
+            return "a merged batch cannot list coincidence groups; use --output-dir";
+        }
+        return NULL;
+    }
+
+    // decode every file of "files"; returns the number that failed
+    int Run(const std::vector<BatchFile> &files, const char *argv0) {
+        RunStats total;
+        stats = &total;
+        usage = argv0;
+        unsigned n_threads = opts.threads ? opts.threads : 1;
+        TaskPool pool(n_threads);
+
+        // merged output: sources first, then the header
+        EventWriter *text = NULL;
+        if (!opts.output_dir) {
+            merged = MakeEventSink(opts);
+            text = dynamic_cast<EventWriter *>(merged);
+            if (text) {
+                text->SetTimeColumn(time_column);
+                text->SetSourceColumn(0);
+            }
+            merged->Comment(("# usage: " + std::string(argv0) + " <data files>\n").c_str());
+            for (size_t i=0; i < files.size(); i++) {
+                char note [64];
+                snprintf(note, sizeof(note), "# source %llu: ", (unsigned long long)i);
+                merged->Comment((note + files[i].path + "\n").c_str());
+            }
+            merged->Header();
+            merged->Flush();
+        }
+
+        // largest files first
+        order.clear();
+        for (size_t i=0; i < files.size(); i++) order.push_back(i);
+        std::stable_sort(order.begin(), order.end(), [&files](size_t a, size_t b) {
+            return files[a].size > files[b].size;
+        });
+        next = 0;
+        n_left = files.size();
+        if (files.empty()) pool.Stop();
+
+        std::vector<std::thread> threads;
+        for (unsigned t=0; t < n_threads; t++) {
+            threads.push_back(std::thread(&BatchRun::Work, this, &pool, t, &files));
+        }
+        for (size_t t=0; t < threads.size(); t++) threads[t].join();
+
+        if (merged) {
+            std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+            merged->Finish();
+            if (merged->Failed()) {
+                fprintf(stderr, "write to standard out failed\n");
+                n_failed++;
+            }
+            delete merged;
+            merged = NULL;
+            total.output_seconds += StatSeconds(t0);
+        }
+        if (opts.stats && !total.Write(opts.stats_file, tool, n_threads)) n_failed++;
+        return n_failed;
+    }
+
+private:
+    const ChunkDecoder          &decoder;
+    const SteinOptions          &opts;
+    const char                  *tool;
+    bool                        time_column;
+    EventSink                   *merged;        // (no --output-dir)
+    std::mutex                  merged_mutex;   // (output and totals)
+    RunStats                    *stats;
+    const char                  *usage;         // (comment atop each output)
+    std::vector<size_t>         order;
+    std::atomic<size_t>         next;           // (in "order")
+    std::atomic<size_t>         n_left;         // files not yet finished
+    std::atomic<int>            n_failed;
+
+    // one thread: decode files, and help with the chunks of others
+    void Work(TaskPool *pool, unsigned self, const std::vector<BatchFile> *files) {
+        while (true) {
+            if (pool->RunOne(self)) continue;
+            size_t k = next++;
+            if (k < order.size()) {
+                if (!RunFile(pool, self, order[k], (*files)[order[k]])) n_failed++;
+                if (--n_left == 0) pool->Stop();
+                continue;
+            }
+            if (!pool->Wait()) return;
+        }
+    }
+
+    // decode file number "source" to its output
+    bool RunFile(TaskPool *pool, unsigned self, size_t source, const BatchFile &file) {
+        InputSource input;
+        if (!input.Open(file.path.c_str(), false, opts.decompress)) {
+            fprintf(stderr, "cannot read %s\n", file.path.c_str());
+            return false;
+        }
+
+        EventSink *output;
+        int fd = -1;
+        std::string outName;
+        HistogramSink *spectra = NULL;
+        CoincidenceSink *matrix = NULL;
+        if (opts.output_dir) {                  // (one output per file)
+            outName = BatchOutputPath(opts.output_dir, file.path, opts.format);
+            fd = open(outName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0) {
+                fprintf(stderr, "cannot write %s\n", outName.c_str());
+                return false;
+            }
+            output = MakeEventSink(opts, fd);
+            if (EventWriter *text = dynamic_cast<EventWriter *>(output)) {
+                text->SetTimeColumn(time_column);
+            }
+            output->Comment(("# usage: " + std::string(usage) + " <data file>\n").c_str());
+            output->Comment(("# " + file.path + "\n").c_str());
+            output->Header();
+        } else if (opts.format == FORMAT_HISTOGRAM) {
+            output = spectra = new HistogramSink(-1);   // (summed at the end)
+        } else if (opts.format == FORMAT_COINCIDENCE) {
+            output = matrix = new CoincidenceSink(-1, opts.coincidence, opts.stamp_period, false);
+        } else {                                // (shared standard out)
+            EventWriter *text = new EventWriter(1);
+            text->SetTimeColumn(time_column);
+            if (opts.kev) text->SetExtraColumn("KEV", fsw_log.kev, 128);
+            text->SetSourceColumn(source);
+            text->SetShared(&merged_mutex);
+            output = text;
+        }
+
+        RunStats file_stats;
+        DecodePipeline pipeline(decoder, *output, pool->Size());
+        pipeline.SetTaskPool(pool, self);
+        if (opts.stats) pipeline.SetStats(&file_stats);
+        uint64_t n_frames = pipeline.Run(input);
+
+        bool ok = true;
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        if (spectra) {
+            std::lock_guard<std::mutex> lock(merged_mutex);
+            ((HistogramSink *)merged)->Merge(*spectra);
+        } else if (matrix) {
+            std::lock_guard<std::mutex> lock(merged_mutex);
+            ((CoincidenceSink *)merged)->Merge(*matrix);
+        } else {
+            output->Finish();
+            ok = !output->Failed();
+        }
+        delete output;
+        if (fd >= 0 && close(fd) != 0) ok = false;
+        file_stats.output_seconds += StatSeconds(t0);
+        if (!ok) fprintf(stderr, "write to %s failed\n", fd >= 0 ? outName.c_str() : "standard out");
+        if (input.Failed()) {
+            fprintf(stderr, "read of %s failed (corrupt or truncated compressed data?)\n",
+                    file.path.c_str());
+            ok = false;
+        }
+
+        std::lock_guard<std::mutex> lock(merged_mutex);
+        fprintf(stderr, "# %s: %llu frames\n", file.path.c_str(), (unsigned long long)n_frames);
+        stats->Add(file_stats);
+        return ok;
+    }
+
+    BatchRun(const BatchRun &);
+    BatchRun &operator=(const BatchRun &);
+};
+
+#endif
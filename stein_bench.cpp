@@ -0,0 +1,411 @@
+//
+// stein_bench.cpp -- C++ micro-benchmarks for the hot paths of the STEIN
+// unpacking tools.  Compiles with g++.  If compiled binary has name
+// "stein_bench", then usage on a UNIX machine is:
+//
+//    ./stein_bench [n_packets] [--evcode-mix=...] [--add-mix=...] [--det-ids=...]
+//
+// where "n_packets" (default 20000) is the number of synthetic 514-byte
+//  FSW packets to generate (198 events each; the mix options are those of
+//  stein_gendata, see stein_synth.h).  Each stage of the tools is timed on
+//  its own -- file read, hex parse, ExtractEvents, Parse_EventReport, the
+//  batch unpack kernels, raw record decode and output formatting -- for
+//  the former implementation and for its replacement where there is one,
+//  and the throughput is printed in MB/s and events/s.
+//
+//    g++ -O2 -o stein_bench stein_bench.cpp
+//
+//
+// Copyright 2013 Karl Yando
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <stdint.h>
+#include <unistd.h>
+using namespace std;
+
+#include "stein_hexparse.h"
+#include "stein_input.h"
+#include "stein_kernel.h"
+#include "stein_layout.h"
+#include "stein_output.h"
+#include "stein_synth.h"
+
+
+// keeps results "live" so the optimizer cannot discard a stage
+static volatile uint64_t bench_sink = 0;
+
+static double Seconds(chrono::steady_clock::time_point t0) {
+    return chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+}
+
+// "bytes" is the volume processed by the stage; "events" the number of
+//   STEIN events it handled (0 if not meaningful for the stage)
+static void Report(const char *stage, const char *impl, double bytes, double events, double secs) {
+    printf("%-12s %-10s %10.3f s %10.1f MB/s", stage, impl, secs, bytes / secs / 1e6);
+    if (events > 0) printf(" %10.2f Mevents/s", events / secs / 1e6);
+    printf("\n");
+}
+
+
+// ---------------------------------------------------------------------
+// HEX PARSE: former Tokenize/substr/strtol chain vs. ParseHexLine
+// ---------------------------------------------------------------------
+
+// former tokenizer from fsw_steinunpack.cpp (reproduced for comparison)
+static void Tokenize(const string& str, vector<string>& tokens,
+                     const string& delimiters = " ") {
+    string::size_type lastPos = str.find_first_not_of(delimiters, 0);
+    string::size_type pos     = str.find_first_of(delimiters, lastPos);
+    while (string::npos != pos || string::npos != lastPos) {
+        tokens.push_back(str.substr(lastPos, pos - lastPos));
+        lastPos = str.find_first_not_of(delimiters, pos);
+        pos = str.find_first_of(delimiters, lastPos);
+    }
+}
+
+static void LegacyHexLine(const string &line, uint16_t packet_bytes[], uint16_t packet_size) {
+    vector<string> tokens;
+    Tokenize(line, tokens, " ");
+    vector<string>::iterator i = tokens.begin();
+    for (uint16_t current_byte=0; current_byte < packet_size; current_byte++) {
+        unsigned int hexbyte_len = (*i).size();
+        string ascii_hexbyte = (*i).substr(2, hexbyte_len-3);
+        char * cstr = new char [hexbyte_len-3];
+        strcpy (cstr, ascii_hexbyte.c_str());
+        char * pEnd;
+        packet_bytes[current_byte] = strtol(cstr,&pEnd,16);
+        delete[] cstr;      // (the original leaked this buffer)
+        i++;
+    }
+}
+
+static void BenchHexParse(const vector<string> &lines) {
+    const uint16_t packet_size = 512;
+    double bytes = 0, events = (double)lines.size() * frame_events;
+    for (size_t i=0; i < lines.size(); i++) bytes += lines[i].size() + 1;
+
+    chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    uint16_t legacy_bytes [packet_size];
+    for (size_t i=0; i < lines.size(); i++) {
+        LegacyHexLine(lines[i], legacy_bytes, packet_size);
+        bench_sink += legacy_bytes[i % packet_size];
+    }
+    Report("hex parse", "legacy", bytes, events, Seconds(t0));
+
+    t0 = chrono::steady_clock::now();
+    uint8_t packet_bytes [packet_size];
+    for (size_t i=0; i < lines.size(); i++) {
+        ParseHexLine(lines[i].data(), lines[i].size(), packet_bytes, packet_size);
+        bench_sink += packet_bytes[i % packet_size];
+    }
+    Report("hex parse", "table", bytes, events, Seconds(t0));
+}
+
+
+// ---------------------------------------------------------------------
+// OUTPUT: former "cout << ... << endl" per event vs. EventWriter
+// ---------------------------------------------------------------------
+
+struct BenchEvent {
+    int16_t evcode, add, det_id, time_stamp;
+    int32_t data;
+};
+
+// the events of the synthetic packets, as decoded
+static vector<BenchEvent> DecodeLines(const vector<string> &lines) {
+    vector<BenchEvent> events(lines.size() * frame_events);
+    uint8_t packet_bytes [synth_packet_bytes];
+    EventBatch batch;
+    for (size_t i=0; i < lines.size(); i++) {
+        ParseHexLine(lines[i].data(), lines[i].size(), packet_bytes, synth_packet_bytes);
+        UnpackFrame_Scalar(packet_bytes + 7, batch);
+        for (uint16_t j=0; j < frame_events; j++) {
+            BenchEvent &e = events[i * frame_events + j];
+            e.evcode = batch.evcode[j]; e.add = batch.add[j]; e.det_id = batch.det_id[j];
+            e.time_stamp = batch.time_stamp[j]; e.data = batch.data[j];
+        }
+    }
+    return events;
+}
+
+static void BenchOutput(const vector<BenchEvent> &events) {
+    size_t n_events = events.size();
+    double bytes = 0;
+    char line [EventWriter::max_line];
+    for (size_t i=0; i < n_events; i++) {
+        const BenchEvent &e = events[i];
+        // (tally the size of the output, one field at a time)
+        bytes += FormatUnsigned(line, i) - line + 6;
+        bytes += FormatSigned(line, e.evcode) - line + FormatSigned(line, e.add) - line;
+        bytes += FormatSigned(line, e.det_id) - line + FormatSigned(line, e.time_stamp) - line;
+        bytes += FormatSigned(line, e.data) - line;
+    }
+
+    // both writers go to /dev/null, so only formatting and syscalls count
+    ofstream legacy ("/dev/null");
+    chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    for (size_t i=0; i < n_events; i++) {
+        const BenchEvent &e = events[i];
+        legacy << i << " " << e.evcode << " " << e.add << " " <<
+            e.det_id << " " << e.time_stamp << " " << e.data << endl;
+    }
+    legacy.flush();
+    Report("output", "legacy", bytes, n_events, Seconds(t0));
+
+    int fd = open("/dev/null", O_WRONLY);
+    t0 = chrono::steady_clock::now();
+    {
+        EventWriter output(fd);
+        for (size_t i=0; i < n_events; i++) {
+            const BenchEvent &e = events[i];
+            output.Event(i, e.evcode, e.add, e.det_id, e.time_stamp, e.data);
+        }
+    }
+    Report("output", "buffered", bytes, n_events, Seconds(t0));
+    close(fd);
+}
+
+
+// ---------------------------------------------------------------------
+// FILE READ: the dump through InputSource (mapped) vs. plain read()
+// ---------------------------------------------------------------------
+
+// (the file was just written, so it is read from the page cache: this
+//   times the input layer, not the disk)
+static void BenchRead(const char *path, double bytes, double events) {
+    chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    uint64_t n_lines = 0;
+    InputSource input;
+    if (input.Open(path)) {
+        while (input.Fill()) {
+            const uint8_t *data = input.Data();
+            const uint8_t *end = data + input.Available();
+            while ((data = (const uint8_t *)memchr(data, '\n', end - data))) {
+                data++;
+                n_lines++;
+            }
+            input.Consume(input.Available());
+        }
+    }
+    bench_sink += n_lines;
+    Report("read", "mmap", bytes, events, Seconds(t0));
+
+    t0 = chrono::steady_clock::now();
+    n_lines = 0;
+    int fd = open(path, O_RDONLY);
+    vector<uint8_t> buffer(1 << 20);
+    ssize_t got;
+    while (fd >= 0 && (got = read(fd, &buffer[0], buffer.size())) > 0) {
+        const uint8_t *data = &buffer[0], *end = data + got;
+        while ((data = (const uint8_t *)memchr(data, '\n', end - data))) {
+            data++;
+            n_lines++;
+        }
+    }
+    if (fd >= 0) close(fd);
+    bench_sink += n_lines;
+    Report("read", "read()", bytes, events, Seconds(t0));
+}
+
+
+// ---------------------------------------------------------------------
+// EXTRACT / PARSE: the two halves of the original decode, timed apart
+// ---------------------------------------------------------------------
+
+static void BenchExtractParse(const vector<uint8_t> &frames) {
+    size_t n_frames = frames.size() / frame_bytes;
+    double events = (double)n_frames * frame_events;
+    vector<uint32_t> reports(n_frames * frame_events);
+
+    chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    for (size_t i=0; i < n_frames; i++) {
+        ExtractEvents(&frames[i * frame_bytes], &reports[i * frame_events]);
+    }
+    bench_sink += reports[reports.size() / 2];
+    Report("extract", "reference", frames.size(), events, Seconds(t0));
+
+    int16_t evcode, add, det_id, time_stamp;
+    int32_t data;
+    t0 = chrono::steady_clock::now();
+    for (size_t i=0; i < reports.size(); i++) {
+        Parse_EventReport(reports[i], evcode, add, det_id, time_stamp, data);
+        bench_sink += data;
+    }
+    Report("parse", "reference", reports.size() * 4.0, events, Seconds(t0));
+    if (reference_errors.evcode || reference_errors.add) {
+        printf("# parse: %llu invalid EVCODE, %llu invalid ADD\n",
+               (unsigned long long)reference_errors.evcode,
+               (unsigned long long)reference_errors.add);
+    }
+}
+
+
+// ---------------------------------------------------------------------
+// RAW DECODE: 32-bit records (rawstein_extract)
+// ---------------------------------------------------------------------
+
+static void BenchRawDecode(size_t n_records, const SynthMix &mix) {
+    SynthGenerator generator(12345, mix);
+    vector<uint8_t> records(n_records * 4);
+    for (size_t i=0; i < n_records; i++) generator.RawRecord(&records[4 * i]);
+
+    int32_t evcode, add, det_id, time_stamp, data;
+    chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+    for (size_t i=0; i < n_records; i++) {
+        DecodeRawEvent(&records[4 * i], evcode, add, det_id, time_stamp, data);
+        bench_sink += evcode + add + det_id + time_stamp + data;
+    }
+    Report("raw decode", "layout", records.size(), n_records, Seconds(t0));
+}
+
+
+// ---------------------------------------------------------------------
+// UNPACK: frame kernels (original reference, scalar, SSE4.1, AVX2)
+// ---------------------------------------------------------------------
+
+static bool SameBatch(const EventBatch &a, const EventBatch &b) {
+    return memcmp(a.evcode, b.evcode, sizeof(a.evcode)) == 0
+        && memcmp(a.add, b.add, sizeof(a.add)) == 0
+        && memcmp(a.det_id, b.det_id, sizeof(a.det_id)) == 0
+        && memcmp(a.time_stamp, b.time_stamp, sizeof(a.time_stamp)) == 0
+        && memcmp(a.data, b.data, sizeof(a.data)) == 0;
+}
+
+// returns the STEIN frames of the packets, for the later stages
+static vector<uint8_t> BenchUnpack(const vector<string> &lines) {
+    vector<FrameKernelInfo> kernels;
+    FrameKernelInfo reference = { "reference", UnpackFrame_Reference };
+    FrameKernelInfo scalar = { "scalar", UnpackFrame_Scalar };
+    kernels.push_back(reference);
+    kernels.push_back(scalar);
+#ifdef STEIN_KERNEL_X86
+    if (__builtin_cpu_supports("sse4.1")) {
+        FrameKernelInfo sse4 = { "sse4", UnpackFrame_SSE4 };
+        kernels.push_back(sse4);
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        FrameKernelInfo avx2 = { "avx2", UnpackFrame_AVX2 };
+        kernels.push_back(avx2);
+    }
+#endif
+
+    // every possible 20-bit report must decode exactly as the original
+    //   ExtractEvents + Parse_EventReport do
+    uint32_t reports [frame_events];
+    uint8_t frame [frame_bytes];
+    EventBatch expect, got;
+    for (size_t k=1; k < kernels.size(); k++) {
+        uint64_t mismatches = 0;
+        for (uint32_t first=0; first < (1u << 20); first += frame_events) {
+            for (uint16_t i=0; i < frame_events; i++) reports[i] = (first + i) & 0xfffff;
+            PackFrame(reports, frame);
+            UnpackFrame_Reference(frame, expect);
+            kernels[k].kernel(frame, got);
+            if (!SameBatch(expect, got)) mismatches++;
+        }
+        printf("# verify %-6s against reference: %s (%llu frames differ)\n", kernels[k].name,
+               mismatches ? "FAILED" : "ok", (unsigned long long)mismatches);
+    }
+
+    // frames taken from the synthetic packets
+    const uint16_t packet_size = 512;
+    vector<uint8_t> frames(lines.size() * frame_bytes);
+    uint8_t packet_bytes [packet_size];
+    for (size_t i=0; i < lines.size(); i++) {
+        ParseHexLine(lines[i].data(), lines[i].size(), packet_bytes, packet_size);
+        memcpy(&frames[i * frame_bytes], packet_bytes + 7, frame_bytes);
+    }
+    double events = (double)lines.size() * frame_events;
+    for (size_t k=0; k < kernels.size(); k++) {
+        chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+        for (size_t i=0; i < lines.size(); i++) {
+            kernels[k].kernel(&frames[i * frame_bytes], got);
+            bench_sink += got.data[i % frame_events];
+        }
+        Report("unpack", kernels[k].name, frames.size(), events, Seconds(t0));
+    }
+    return frames;
+}
+
+// the raw 32-bit layout must decode exactly as the original byte
+//   arithmetic of rawstein_extract did (every 1st/3rd/4th byte value)
+static void VerifyRawLayout() {
+    uint64_t mismatches = 0;
+    uint8_t r[4];
+    int32_t evcode, add, det_id, time_stamp, data;
+    for (uint32_t v=0; v < (1u << 24); v++) {
+        r[0] = v >> 16; r[2] = v >> 8; r[3] = v; r[1] = r[0] ^ r[3];
+        DecodeRawEvent(r, evcode, add, det_id, time_stamp, data);
+        unsigned char ev = (r[0] >> 6) & 0xff;
+        unsigned char ad = (r[0] >> 5) - (ev << 1);
+        unsigned char det = r[0] - ((r[0] >> 5) << 5);
+        unsigned short dat = (r[2] << 8) + r[3];
+        dat = dat + 32768;
+        if (evcode != ev || add != ad || det_id != det || time_stamp != r[1] || data != dat) {
+            mismatches++;
+        }
+    }
+    printf("# verify raw layout against original: %s (%llu records differ)\n",
+           mismatches ? "FAILED" : "ok", (unsigned long long)mismatches);
+}
+
+
+int main(int argc, char *argv[]) {
+    size_t n_packets = 20000;
+    SynthMix mix;
+    for (int i=1; i < argc; i++) {
+        int used = ParseMixOption(argv[i], mix);
+        if (used < 0) return 1;
+        if (used == 0) n_packets = strtoul(argv[i], NULL, 10);
+    }
+
+    // a synthetic FSW dump (stein_synth.h): in memory, one string per
+    //   line, and in a temporary file for the read stage
+    SynthGenerator generator(12345, mix);
+    vector<string> lines(n_packets);
+    vector<char> line(synth_max_fsw_line);
+    uint8_t packet [synth_packet_bytes];
+    char path[] = "/tmp/stein_bench.XXXXXX";
+    int fd = mkstemp(path);
+    double bytes = 0;
+    for (size_t i=0; i < n_packets; i++) {
+        generator.FswPacket(i, packet);
+        size_t len = SynthGenerator::FswLine(packet, &line[0]);
+        if (fd >= 0) WriteAll(fd, &line[0], len);
+        lines[i].assign(&line[0], len - 1);
+        bytes += len;
+    }
+    if (fd >= 0) close(fd);
+    printf("# %zu synthetic packets\n", n_packets);
+
+    if (fd >= 0) BenchRead(path, bytes, (double)n_packets * frame_events);
+    unlink(path);
+    BenchHexParse(lines);
+    vector<uint8_t> frames = BenchUnpack(lines);
+    BenchExtractParse(frames);
+    VerifyRawLayout();
+    BenchRawDecode(n_packets * frame_events, mix);
+    BenchOutput(DecodeLines(lines));
+    return (int)(bench_sink & 0);
+}
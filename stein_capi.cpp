@@ -0,0 +1,264 @@
+//
+// stein_capi.cpp -- libstein, the C interface of stein_capi.h.  Compiles
+//  with g++ into a shared library:
+//
+//    g++ -O2 -shared -fPIC -fvisibility=hidden -pthread -o libstein.so stein_capi.cpp
+//
+// A source is the decode pipeline of the command-line tools (see
+//  stein_pipeline.h) fed one batch of input chunks at a time, as the
+//  caller asks for events: the chunks of a batch (one per thread) are
+//  decoded, in parallel with "n_threads" > 1, into a ColumnBuffer, whose
+//  columns are then copied out to the caller's arrays.  Only one batch of
+//  decoded events is held, however large the data file.
+//
+//
+// Copyright 2013 Karl Yando
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <errno.h>
+#include <new>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#include "stein_capi.h"
+#include "stein_fsw.h"
+#include "stein_input.h"
+#include "stein_output.h"
+#include "stein_pipeline.h"
+#include "stein_raw.h"
+
+
+// decoded events, one vector per column (in stein_read()'s types), until
+//   the caller takes them
+class ColumnBuffer : public EventSink {
+public:
+    ColumnBuffer() : next(0), packet_time(0) {}
+
+    void Packet(const PacketInfo &info) { packet_time = info.time; }
+
+    void Event(uint64_t frame, int32_t evcode, int32_t add, int32_t det_id,
+               int32_t time_stamp, int32_t data) {
+        this->frame.push_back((int64_t)frame);
+        this->evcode.push_back(evcode);
+        this->add.push_back(add);
+        this->det_id.push_back(det_id);
+        this->time_stamp.push_back(time_stamp);
+        this->data.push_back(data);
+        this->time.push_back(packet_time);
+    }
+
+    size_t Pending() const { return frame.size() - next; }
+
+    // move up to "n" events to the columns that are not NULL, from "at"
+    //   on; returns the number moved
+    size_t Take(size_t n, size_t at, int64_t *frame, int32_t *evcode, int32_t *add,
+                int32_t *det_id, int32_t *time_stamp, int32_t *data, uint64_t *time) {
+        if (n > Pending()) n = Pending();
+        Copy(frame, at, this->frame, n);
+        Copy(evcode, at, this->evcode, n);
+        Copy(add, at, this->add, n);
+        Copy(det_id, at, this->det_id, n);
+        Copy(time_stamp, at, this->time_stamp, n);
+        Copy(data, at, this->data, n);
+        Copy(time, at, this->time, n);
+        next += n;
+        if (next == this->frame.size()) Clear();
+        return n;
+    }
+
+private:
+    std::vector<int64_t>    frame;
+    std::vector<int32_t>    evcode, add, det_id, time_stamp, data;
+    std::vector<uint64_t>   time;
+    size_t                  next;           // first event not yet taken
+    uint64_t                packet_time;    // (of the events being added)
+
+    template <typename T>
+    void Copy(T *to, size_t at, const std::vector<T> &from, size_t n) const {
+        if (to && n) memcpy(to + at, &from[next], n * sizeof(T));
+    }
+
+    void Clear() {
+        frame.clear(); evcode.clear(); add.clear(); det_id.clear();
+        time_stamp.clear(); data.clear(); time.clear();
+        next = 0;
+    }
+};
+
+
+struct stein_source {
+    InputSource         input;
+    ChunkDecoder        *decoder;
+    ColumnBuffer        buffer;
+    DecodePipeline      *pipeline;
+    unsigned            n_threads;
+    bool                at_eof;         // nothing more to read
+    bool                done;           // every chunk decoded
+    const char          *error;
+
+    stein_source() : decoder(NULL), pipeline(NULL), n_threads(1), at_eof(false), done(false),
+                     error(NULL) {}
+    ~stein_source() {
+        if (pipeline) pipeline->Drain();
+        delete pipeline;
+        delete decoder;
+    }
+
+    // decode the next batch of chunks into "buffer"; returns false at the
+    //   end of the data
+    bool DecodeBatch() {
+        if (done) return false;
+        unsigned n_chunks = 0;
+        while (n_chunks < n_threads) {
+            size_t avail = input.Available();
+            size_t len = avail ? decoder->ChunkLength(input.Data(), avail,
+                                                      DecodePipeline::chunk_size, at_eof) : 0;
+            if (len == 0) {                     // (need more input)
+                if (at_eof) break;              // (a partial record is not decoded)
+                at_eof = !input.Fill();
+                continue;
+            }
+            pipeline->Submit(input.Data(), len, input.IsMapped());
+            input.Consume(len);
+            n_chunks++;
+        }
+        pipeline->Flush();
+        if (n_chunks == 0) {
+            pipeline->Drain();
+            done = true;
+            if (input.Failed()) error = "read failed (corrupt or truncated compressed data?)";
+        }
+        return n_chunks > 0;
+    }
+
+private:
+    stein_source(const stein_source &);
+    stein_source &operator=(const stein_source &);
+};
+
+
+extern "C" {
+
+int stein_abi_version(void) {
+    return STEIN_ABI_VERSION;
+}
+
+stein_source *stein_open(const char *path, int format, int n_threads) {
+    if (!path || format < STEIN_FSW || format > STEIN_RAW_SIMFSW) {
+        errno = EINVAL;
+        return NULL;
+    }
+    stein_source *src = new (std::nothrow) stein_source;
+    if (!src) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    try {
+        if (!src->input.Open(path)) {
+            int saved = errno;
+            delete src;
+            errno = saved;
+            return NULL;
+        }
+        if (format == STEIN_FSW) {
+            FswPacketDecoder *fsw = new FswPacketDecoder;
+            fsw->SetPacketInfo(true);           // (packet times)
+            src->decoder = fsw;
+        } else {
+            src->decoder = new RawRecordDecoder(format == STEIN_RAW_SIMFSW);
+        }
+        src->n_threads = (n_threads > 1) ? n_threads : 1;
+        src->pipeline = new DecodePipeline(*src->decoder, src->buffer, src->n_threads);
+    } catch (const std::bad_alloc &) {
+        delete src;
+        errno = ENOMEM;
+        return NULL;
+    }
+    return src;
+}
+
+int64_t stein_read(stein_source *src, int64_t max_events, int64_t *frame, int32_t *evcode,
+                   int32_t *add, int32_t *det_id, int32_t *time_stamp, int32_t *data,
+                   uint64_t *packet_time) {
+    if (!src || max_events < 0) return -1;
+    size_t n = 0;
+    try {
+        while (n < (uint64_t)max_events) {
+            if (src->buffer.Pending()) {
+                n += src->buffer.Take(max_events - n, n, frame, evcode, add, det_id,
+                                      time_stamp, data, packet_time);
+            } else if (!src->DecodeBatch()) {
+                break;
+            }
+        }
+    } catch (const std::bad_alloc &) {
+        src->error = "out of memory";
+        return -1;
+    }
+    if (n == 0 && src->error) return -1;
+    return n;
+}
+
+const char *stein_error(const stein_source *src) {
+    return src ? src->error : NULL;
+}
+
+void stein_close(stein_source *src) {
+    delete src;
+}
+
+int64_t stein_packet_time_ticks(void) {
+    return (int64_t)packet_time_ticks;
+}
+
+
+// IDL CALL_EXTERNAL: every argument arrives by reference, except the
+//   path string (passed by value, i.e. as a C string)
+int64_t stein_idl_open(int argc, void *argv[]) {
+    if (argc != 3) return 0;
+    stein_source *src = stein_open((const char *)argv[0], *(int32_t *)argv[1],
+                                   *(int32_t *)argv[2]);
+    return (int64_t)(intptr_t)src;
+}
+
+int64_t stein_idl_read(int argc, void *argv[]) {
+    if (argc != 9) return -1;
+    stein_source *src = (stein_source *)(intptr_t)*(int64_t *)argv[0];
+    return stein_read(src, *(int64_t *)argv[1], (int64_t *)argv[2], (int32_t *)argv[3],
+                      (int32_t *)argv[4], (int32_t *)argv[5], (int32_t *)argv[6],
+                      (int32_t *)argv[7], (uint64_t *)argv[8]);
+}
+
+char *stein_idl_error(int argc, void *argv[]) {
+    static char none[] = "";
+    if (argc != 1) return none;
+    const char *error = stein_error((stein_source *)(intptr_t)*(int64_t *)argv[0]);
+    return error ? (char *)error : none;
+}
+
+int64_t stein_idl_close(int argc, void *argv[]) {
+    if (argc != 1) return -1;
+    stein_close((stein_source *)(intptr_t)*(int64_t *)argv[0]);
+    *(int64_t *)argv[0] = 0;
+    return 0;
+}
+
+int64_t stein_idl_packet_time_ticks(int argc, void *argv[]) {
+    (void)argc; (void)argv;
+    return stein_packet_time_ticks();
+}
+
+}
@@ -0,0 +1,113 @@
+/*
+ * stein_capi.h -- C interface of libstein, the event decoders of
+ *  fsw_steinunpack and rawstein_extract as a shared library, so that IDL
+ *  (CALL_EXTERNAL; see read_stein_events.pro) and Python (ctypes/NumPy;
+ *  see stein_capi.py) get event arrays straight from the data file,
+ *  without an ASCII event list in between.  Build with:
+ *
+ *    g++ -O2 -shared -fPIC -fvisibility=hidden -pthread -o libstein.so stein_capi.cpp
+ *
+ * A source is opened, read in batches into columns the caller provides,
+ *  and closed:
+ *
+ *    stein_source *src = stein_open("STEINBYTESLOG.log", STEIN_FSW, 4);
+ *    int64_t n;
+ *    while ((n = stein_read(src, max, frame, evcode, add, det_id,
+ *                           time_stamp, data, packet_time)) > 0) {
+ *        ... n events, in frame order ...
+ *    }
+ *    if (n < 0) fprintf(stderr, "%s\n", stein_error(src));
+ *    stein_close(src);
+ *
+ * The events, frame numbers included, are those of the ASCII event list
+ *  of a single-file run of the matching tool with no filters; compressed
+ *  data files are read as they are there (see stein_input.h).
+ *
+ * ABI: only the functions below are exported; their signatures stay as
+ *  they are for a given STEIN_ABI_VERSION (stein_abi_version() reports the
+ *  library's).  Every function is safe to call from any thread, but one
+ *  source must not be used by two threads at once.
+ *
+ *
+ * Copyright 2013 Karl Yando
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef STEIN_CAPI_H
+#define STEIN_CAPI_H
+
+#include <stdint.h>
+
+#define STEIN_ABI_VERSION 1
+
+#if defined(__GNUC__)
+#define STEIN_API __attribute__((visibility("default")))
+#else
+#define STEIN_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* formats of data file */
+enum {
+    STEIN_FSW        = 0,   /* FSW ASCII dump (fsw_steinunpack) */
+    STEIN_RAW        = 1,   /* raw 32-bit records (rawstein_extract) */
+    STEIN_RAW_SIMFSW = 2    /* raw records, as with "--simulate-fsw" */
+};
+
+typedef struct stein_source stein_source;
+
+/* STEIN_ABI_VERSION of the library */
+STEIN_API int stein_abi_version(void);
+
+/* open data file "path" ("-": standard input) of "format", decoded on
+ *  "n_threads" threads (< 1: one); NULL if it cannot be opened (errno
+ *  says why) */
+STEIN_API stein_source *stein_open(const char *path, int format, int n_threads);
+
+/* decode up to "max_events" more events into the columns, each an array
+ *  of at least "max_events" values (or NULL, if not wanted); returns the
+ *  number of events stored, 0 at the end of the data, -1 on error (see
+ *  stein_error()).  "packet_time" is the time of each event's packet, in
+ *  units of 1 / stein_packet_time_ticks() s since January 1, 00:00 of the
+ *  dump's year, decoded from the packet's month / day / hour / minute /
+ *  second / fraction timestamp (FSW dumps; 0 for raw data). */
+STEIN_API int64_t stein_read(stein_source *src, int64_t max_events, int64_t *frame,
+                             int32_t *evcode, int32_t *add, int32_t *det_id,
+                             int32_t *time_stamp, int32_t *data, uint64_t *packet_time);
+
+/* what went wrong, after stein_read() returned -1 (NULL otherwise) */
+STEIN_API const char *stein_error(const stein_source *src);
+
+/* close the data file and free "src" (NULL is ignored) */
+STEIN_API void stein_close(stein_source *src);
+
+/* "packet_time" units per second (256: the timestamp fraction is 1/256 s) */
+STEIN_API int64_t stein_packet_time_ticks(void);
+
+/* the same calls for IDL's CALL_EXTERNAL (argc/argv convention; see
+ *  read_stein_events.pro): handles are passed as LONG64 */
+STEIN_API int64_t stein_idl_open(int argc, void *argv[]);
+STEIN_API int64_t stein_idl_read(int argc, void *argv[]);
+STEIN_API char *stein_idl_error(int argc, void *argv[]);
+STEIN_API int64_t stein_idl_close(int argc, void *argv[]);
+STEIN_API int64_t stein_idl_packet_time_ticks(int argc, void *argv[]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,179 @@
+#!/usr/bin/env python
+#
+# stein_capi.py - Python (ctypes + NumPy) interface to libstein, the event
+#    decoders of fsw_steinunpack / rawstein_extract as a shared library
+#    (see stein_capi.h; build libstein.so from stein_capi.cpp)
+#
+# Events come straight from the data file into NumPy arrays, one per
+#  column (frame, evcode, add, det_id, time_stamp, data, and for FSW dumps
+#  packet_time, in seconds since January 1), with no ASCII event list in
+#  between:
+#
+# >>> import stein_capi
+# >>> ev = stein_capi.read_events("STEINBYTESLOG.log", "fsw", threads=4)
+# >>> ev["data"][ev["evcode"] == 0]
+#
+# or a batch at a time, for files larger than memory:
+#
+# >>> with stein_capi.SteinSource("STEIN_RAWBYTESLOG.log", "raw") as src:
+# ...     for ev in src.batches(1 << 20):
+# ...         ...
+#
+# libstein.so is looked for in $STEIN_LIBRARY, next to this file, and
+#  then on the usual library path.
+#
+# Author:
+#  Karl Yando
+#
+#########################################
+# Copyright 2013 Karl Yando
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#########################################
+
+
+import ctypes
+import ctypes.util
+import os
+
+import numpy
+
+ABI_VERSION = 1                 # (STEIN_ABI_VERSION of stein_capi.h)
+FORMATS = {"fsw": 0, "raw": 1, "raw-simfsw": 2}
+
+# column name, NumPy type, ctypes type, as stein_read() takes them
+COLUMNS = [("frame",      numpy.int64,  ctypes.c_int64),
+           ("evcode",     numpy.int32,  ctypes.c_int32),
+           ("add",        numpy.int32,  ctypes.c_int32),
+           ("det_id",     numpy.int32,  ctypes.c_int32),
+           ("time_stamp", numpy.int32,  ctypes.c_int32),
+           ("data",       numpy.int32,  ctypes.c_int32),
+           ("packet_time", numpy.uint64, ctypes.c_uint64)]
+
+_lib = None
+
+def load_library():
+    """Loads libstein (once), and declares its functions."""
+    global _lib
+    if _lib is not None:
+        return _lib
+    candidates = [os.environ.get("STEIN_LIBRARY"),
+                  os.path.join(os.path.dirname(os.path.abspath(__file__)), "libstein.so"),
+                  ctypes.util.find_library("stein")]
+    lib = None
+    for path in candidates:
+        if path and (os.path.exists(path) or not os.path.isabs(path)):
+            lib = ctypes.CDLL(path, use_errno=True)
+            break
+    if lib is None:
+        raise OSError("libstein.so not found (build it from stein_capi.cpp, "
+                      "or set STEIN_LIBRARY)")
+    if lib.stein_abi_version() != ABI_VERSION:
+        raise OSError("libstein ABI version %d, expected %d"
+                      % (lib.stein_abi_version(), ABI_VERSION))
+
+    lib.stein_open.restype = ctypes.c_void_p
+    lib.stein_open.argtypes = [ctypes.c_char_p, ctypes.c_int, ctypes.c_int]
+    lib.stein_read.restype = ctypes.c_int64
+    lib.stein_read.argtypes = ([ctypes.c_void_p, ctypes.c_int64] +
+                               [ctypes.POINTER(c) for (_, _, c) in COLUMNS])
+    lib.stein_error.restype = ctypes.c_char_p
+    lib.stein_error.argtypes = [ctypes.c_void_p]
+    lib.stein_close.restype = None
+    lib.stein_close.argtypes = [ctypes.c_void_p]
+    lib.stein_packet_time_ticks.restype = ctypes.c_int64
+    lib.stein_packet_time_ticks.argtypes = []
+    _lib = lib
+    return lib
+
+
+class SteinSource(object):
+    """An open data file of format "fsw", "raw" or "raw-simfsw", decoded
+       on "threads" threads."""
+
+    def __init__(self, filename, format="fsw", threads=1):
+        if format not in FORMATS:
+            raise ValueError("format must be one of %s" % ", ".join(sorted(FORMATS)))
+        self.handle = None
+        self.lib = load_library()
+        self.format = format
+        if not isinstance(filename, bytes):
+            filename = filename.encode()
+        self.handle = self.lib.stein_open(filename, FORMATS[format], threads)
+        if not self.handle:
+            errno = ctypes.get_errno()
+            raise IOError(errno, os.strerror(errno), filename)
+
+    def read(self, max_events=1 << 20):
+        """Returns a dict of the next (up to) "max_events" events' columns,
+           or None at the end of the data."""
+        if not self.handle:
+            raise ValueError("read from a closed SteinSource")
+        arrays = {}
+        pointers = []
+        for (name, dtype, ctype) in COLUMNS:
+            if name == "packet_time" and self.format != "fsw":
+                pointers.append(None)
+                continue
+            arrays[name] = numpy.empty(max_events, dtype=dtype)
+            pointers.append(arrays[name].ctypes.data_as(ctypes.POINTER(ctype)))
+        n = self.lib.stein_read(self.handle, max_events, *pointers)
+        if n < 0:
+            raise IOError(self.lib.stein_error(self.handle).decode())
+        if n == 0:
+            return None
+        events = {}
+        for name in arrays:
+            events[name] = arrays[name][:n]
+        if "packet_time" in events:
+            events["packet_time"] = (events["packet_time"] /
+                                     float(self.lib.stein_packet_time_ticks()))
+        return events
+
+    def batches(self, max_events=1 << 20):
+        """Yields read(max_events) until the end of the data."""
+        while True:
+            events = self.read(max_events)
+            if events is None:
+                return
+            yield events
+
+    def close(self):
+        if self.handle:
+            self.lib.stein_close(self.handle)
+            self.handle = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def __del__(self):
+        self.close()
+
+
+def read_events(filename, format="fsw", threads=1):
+    """Returns a dict of every event's columns in "filename" (see
+       SteinSource)."""
+    with SteinSource(filename, format, threads) as src:
+        parts = list(src.batches())
+    events = {}
+    for (name, dtype, _) in COLUMNS:
+        if name == "packet_time" and format != "fsw":
+            continue
+        if name == "packet_time":
+            dtype = numpy.float64
+        events[name] = numpy.concatenate([p[name] for p in parts]) if parts \
+                       else numpy.empty(0, dtype=dtype)
+    return events
@@ -0,0 +1,250 @@
+//
+// stein_coincidence.h -- one-pass search for coincident EVCODE 0 hits on
+//  different detector pixels ("--coincidence=W"): an EventSink that pairs
+//  every hit with the recent hits of all DET_IDs, in place of the event
+//  list, e.g. to check crosstalk and noise across a whole campaign.
+//
+// TIME: EVCODE 0 events carry a short TIME_STAMP that wraps (6 bits, 2 LSBs
+//  dropped, in FSW dumps and with --simulate-fsw; 8 bits in raw data).  It
+//  is unwrapped by event order: events arrive in time order, so a
+//  TIME_STAMP smaller than the one before is taken as one wrap.  (A whole
+//  wrap period without any EVCODE 0 hit cannot be seen, and counts as no
+//  time.)  In FSW dumps the packets mark where that reasoning breaks down:
+//  after a missing packet (lost, skipped by validation, or outside --from /
+//  --to) or a packet time that goes backwards (as at the turn of the year,
+//  which the timestamp does not record), the search starts afresh,
+//  and no hit before the break pairs with one after it.
+//
+// Hits at most W TIME_STAMP counts apart coincide.  The recent hits of each
+//  DET_ID are kept in a ring of ring_size entries, so each hit costs a
+//  fixed amount of work however long the run; should more than ring_size
+//  hits of one DET_ID fall within W, the oldest are forgotten (and the
+//  pairs missed are counted in the summary).
+//
+// Output, written at the end of the run:
+//    (default)               the DET_ID x DET_ID matrix of hit pairs, one
+//                            row per DET_ID: its hits, then its pairs with
+//                            each DET_ID (symmetric; the diagonal counts
+//                            repeat hits on one pixel)
+//
+//      # DET_ID / HITS / D0 / D1 / ... / D31
+//      3 18211 2 0 0 41 ...
+//
+//    --coincidence-groups    every group of hits within W of its first hit
+//                            that spans two DET_IDs or more, one line per
+//                            hit: the group number, and the hit's frame,
+//                            DET_ID, TIME_STAMP counts after the first hit
+//                            and DATA (written as the groups close)
+//
+//      # group / frame / DET_ID / DT / DATA
+//      0 1187 3 0 45
+//      0 1190 4 1 12
+//
+// Either is plain integer columns, which LOAD_EVENTLIST reads as-is.
+//
+//
+// Copyright 2013 Karl Yando
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef STEIN_COINCIDENCE_H
+#define STEIN_COINCIDENCE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "stein_output.h"
+
+class CoincidenceSink : public EventSink {
+public:
+    static const int n_det = 32;
+    static const int ring_size = 16;            // recent hits kept per DET_ID
+
+    // "window": TIME_STAMP counts within which hits coincide; "period":
+    //   the EVCODE 0 TIME_STAMP wrap (64 FSW, 256 raw); "groups": list the
+    //   groups instead of the matrix
+    CoincidenceSink(int fd, uint32_t window, uint32_t period, bool groups)
+        : writer(fd), window(window), period(period), groups(groups), epoch(0),
+          last_stamp(0), have_stamp(false), have_packet(false), last_packet(0), last_time(0),
+          group_start(0), n_groups(0), n_lost(0), n_breaks(0) {
+        memset(rings, 0, sizeof(rings));
+        memset(hits, 0, sizeof(hits));
+        memset(pairs, 0, sizeof(pairs));
+    }
+
+    void Packet(const PacketInfo &info) {
+        if (have_packet && (info.packet != last_packet + 1 || info.time < last_time)) Break();
+        have_packet = true;
+        last_packet = info.packet;
+        last_time = info.time;
+    }
+
+    void Event(uint64_t frame, int32_t evcode, int32_t /*add*/, int32_t det_id,
+               int32_t time_stamp, int32_t data) {
+        if (evcode != 0 || (uint32_t)det_id >= (uint32_t)n_det) return;
+        if (have_stamp && (uint32_t)time_stamp < last_stamp) epoch += period;
+        last_stamp = (uint32_t)time_stamp;
+        have_stamp = true;
+        uint64_t t = epoch + (uint32_t)time_stamp;
+
+        // pair with the recent hits of every DET_ID (newest first)
+        hits[det_id]++;
+        for (int d=0; d < n_det; d++) {
+            const Ring &ring = rings[d];
+            for (uint32_t k=0; k < ring.n; k++) {
+                if (t - ring.time[(ring.next - 1 - k) & (ring_size - 1)] > window) break;
+                pairs[d][det_id]++;
+                if (d != det_id) pairs[det_id][d]++;
+            }
+        }
+        Ring &ring = rings[det_id];
+        if (ring.n == ring_size) {
+            if (t - ring.time[ring.next] <= window) n_lost++;
+        } else {
+            ring.n++;
+        }
+        ring.time[ring.next] = t;
+        ring.next = (ring.next + 1) & (ring_size - 1);
+
+        if (groups) {
+            if (!group.empty() && t - group_start > window) CloseGroup();
+            if (group.empty()) group_start = t;
+            Hit hit = { frame, det_id, (uint32_t)(t - group_start), data };
+            group.push_back(hit);
+        }
+    }
+
+    void Header() {
+        if (groups) writer.Write("# group / frame / DET_ID / DT / DATA\n");
+    }
+    void Comment(const char *text) { writer.Write(text); }
+    void Flush() { writer.Flush(); }
+    bool Failed() const { return writer.Failed(); }
+
+    // add the matrix of "other" (a whole run), e.g. one file's pairs into
+    //   those of a batch
+    void Merge(const CoincidenceSink &other) {
+        for (int d=0; d < n_det; d++) {
+            hits[d] += other.hits[d];
+            for (int e=0; e < n_det; e++) pairs[d][e] += other.pairs[d][e];
+        }
+        n_lost += other.n_lost;
+        n_breaks += other.n_breaks;
+    }
+
+    void Finish() {
+        if (groups) {
+            CloseGroup();
+        } else {
+            WriteMatrix();
+        }
+        if (n_lost || n_breaks) {       // (stderr, so the output stays plain columns)
+            fprintf(stderr, "# coincidence: %llu pairs missed (more than %d hits of a DET_ID"
+                    " within the window), %llu breaks in the data\n",
+                    (unsigned long long)n_lost, ring_size, (unsigned long long)n_breaks);
+        }
+        writer.Flush();
+    }
+
+private:
+    struct Ring {
+        uint64_t    time [ring_size];   // unwrapped TIME_STAMPs
+        uint32_t    next;               // (slot of the next hit)
+        uint32_t    n;                  // slots in use
+    };
+    struct Hit {
+        uint64_t    frame;
+        int32_t     det_id;
+        uint32_t    dt;                 // (after the group's first hit)
+        int32_t     data;
+    };
+
+    EventWriter         writer;
+    uint32_t            window;
+    uint32_t            period;
+    bool                groups;
+    uint64_t            epoch;          // unwrapped time of TIME_STAMP 0
+    uint32_t            last_stamp;
+    bool                have_stamp;
+    bool                have_packet;
+    uint64_t            last_packet;
+    uint64_t            last_time;      // (packet time)
+    Ring                rings [n_det];
+    uint64_t            hits [n_det];
+    uint64_t            pairs [n_det][n_det];
+    std::vector<Hit>    group;          // (--coincidence-groups) open group
+    uint64_t            group_start;
+    uint64_t            n_groups;       // groups written
+    uint64_t            n_lost;         // pairs missed (ring overrun)
+    uint64_t            n_breaks;       // restarts (packet gaps)
+
+    // a gap in the data: forget every hit so far
+    void Break() {
+        CloseGroup();
+        for (int d=0; d < n_det; d++) rings[d].n = 0;
+        epoch += period;                // (unwrapped time never goes back)
+        have_stamp = false;
+        n_breaks++;
+    }
+
+    // write the open group, if it spans two DET_IDs or more
+    void CloseGroup() {
+        uint32_t dets = 0;
+        for (size_t i=0; i < group.size(); i++) dets |= 1u << group[i].det_id;
+        if (dets & (dets - 1)) {
+            for (size_t i=0; i < group.size(); i++) {
+                char line [max_event_line];
+                char *p = FormatUnsigned(line, n_groups);         *p++ = ' ';
+                p = FormatUnsigned(p, group[i].frame);            *p++ = ' ';
+                p = FormatSigned(p, group[i].det_id);             *p++ = ' ';
+                p = FormatUnsigned(p, group[i].dt);               *p++ = ' ';
+                p = FormatSigned(p, group[i].data);               *p++ = '\n';
+                writer.Write(line, p - line);
+            }
+            n_groups++;
+        }
+        group.clear();
+    }
+
+    void WriteMatrix() {
+        char line [64];
+        snprintf(line, sizeof(line), "# coincidence window: %u TIME_STAMP counts\n", window);
+        writer.Write(line);
+        writer.Write("# DET_ID / HITS");
+        for (int d=0; d < n_det; d++) {
+            snprintf(line, sizeof(line), " / D%d", d);
+            writer.Write(line);
+        }
+        writer.Write("\n");
+        for (int d=0; d < n_det; d++) {
+            char row [(n_det + 2) * 21];
+            char *p = FormatSigned(row, d);
+            *p++ = ' ';
+            p = FormatUnsigned(p, hits[d]);
+            for (int e=0; e < n_det; e++) {
+                *p++ = ' ';
+                p = FormatUnsigned(p, pairs[d][e]);
+            }
+            *p++ = '\n';
+            writer.Write(row, p - row);
+        }
+    }
+
+    CoincidenceSink(const CoincidenceSink &);
+    CoincidenceSink &operator=(const CoincidenceSink &);
+};
+
+#endif
@@ -0,0 +1,349 @@
+//
+// stein_columnar.h -- binary, column-oriented event-list format, with a
+//  writer (an EventSink, selected by "--format=columnar") and a reader
+//  that memory-maps a file and exposes each column in place.
+//
+// FILE LAYOUT (all integers little-endian):
+//
+//    ColumnarHeader                       32 bytes
+//    ColumnarEntry [n_columns]            32 bytes each
+//    (padding to column_align)
+//    column 0: n_events values            starts on a column_align boundary
+//    (padding to column_align)
+//    column 1: ...
+//
+// The six columns are, in order, frame / evcode / add / det_id /
+//  time_stamp / data -- the same fields as the ASCII event list.  Each is
+//  stored with the narrowest integer type that holds every value in it
+//  (e.g. evcode as uint8, add/det_id as int8, data as uint16 for raw data),
+//  as recorded by its ColumnarEntry.
+//
+// The writer never holds more than a small buffer per column in memory:
+//  values are spilled to temporary files during the run -- frame as 64
+//  bits, the other fields at the 16 bits their layouts need (stein_layout.h:
+//  EVCODE / ADD / DET_ID / TIME_STAMP -1 .. 255, DATA 0 .. 65535) -- and
+//  narrowed as they are copied into place by Finish().
+//
+// Header, column table and columns are written, and read in place, in the
+//  host's byte order, so the format is only built for little-endian hosts.
+//
+//
+// Copyright 2013 Karl Yando
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef STEIN_COLUMNAR_H
+#define STEIN_COLUMNAR_H
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "stein_output.h"
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__,
+              "columnar event lists are little-endian, written and read in place");
+
+static const char     columnar_magic[8] = {'S','T','E','I','N','C','O','L'};
+static const uint32_t columnar_version = 1;
+static const uint32_t column_align = 64;        // (cache line / SIMD friendly)
+
+enum ColumnIndex { COL_FRAME, COL_EVCODE, COL_ADD, COL_DETID, COL_TIMESTAMP, COL_DATA, N_COLUMNS };
+static const char * const column_names[N_COLUMNS] =
+    { "frame", "evcode", "add", "det_id", "time_stamp", "data" };
+
+// storage type of a column (low nibble = bytes per value)
+enum ColumnType {
+    COLTYPE_UINT8 = 0x01, COLTYPE_UINT16 = 0x02, COLTYPE_UINT32 = 0x04, COLTYPE_UINT64 = 0x08,
+    COLTYPE_INT8  = 0x11, COLTYPE_INT16  = 0x12, COLTYPE_INT32  = 0x14, COLTYPE_INT64  = 0x18
+};
+inline uint32_t ColumnWidth(uint32_t type) { return type & 0x0f; }
+inline bool ColumnTypeKnown(uint32_t type) {
+    switch (type) {
+        case COLTYPE_UINT8: case COLTYPE_UINT16: case COLTYPE_UINT32: case COLTYPE_UINT64:
+        case COLTYPE_INT8:  case COLTYPE_INT16:  case COLTYPE_INT32:  case COLTYPE_INT64:
+            return true;
+    }
+    return false;
+}
+inline bool ColumnSigned(uint32_t type) { return (type & 0x10) != 0; }
+
+struct ColumnarHeader {
+    char        magic[8];       // "STEINCOL"
+    uint32_t    version;        // columnar_version
+    uint32_t    n_columns;      // N_COLUMNS
+    uint64_t    n_events;       // values per column
+    uint32_t    header_size;    // header + column table, before padding
+    uint32_t    align;          // column_align
+};
+
+struct ColumnarEntry {
+    char        name[12];       // NUL-padded column name
+    uint32_t    type;           // ColumnType
+    uint64_t    offset;         // byte offset of the column from file start
+    uint64_t    size;           // byte length of the column
+};
+
+// narrowest type holding every value in [lo, hi]
+inline uint32_t NarrowestType(int64_t lo, int64_t hi) {
+    if (lo >= 0) {
+        if (hi <= 0xff)         return COLTYPE_UINT8;
+        if (hi <= 0xffff)       return COLTYPE_UINT16;
+        if (hi <= 0xffffffffLL) return COLTYPE_UINT32;
+        return COLTYPE_UINT64;
+    }
+    if (lo >= -128 && hi <= 127)                 return COLTYPE_INT8;
+    if (lo >= -32768 && hi <= 32767)             return COLTYPE_INT16;
+    if (lo >= -2147483648LL && hi <= 2147483647) return COLTYPE_INT32;
+    return COLTYPE_INT64;
+}
+
+
+class ColumnarWriter : public EventSink {
+public:
+    static const size_t spill_count = 8192;     // values buffered per column
+
+    explicit ColumnarWriter(int fd = 1) : fd(fd), n_events(0), used(0), failed(false) {
+        for (int c=0; c < N_COLUMNS; c++) {
+            spill[c] = tmpfile();
+            if (!spill[c]) failed = true;
+            lo[c] = INT64_MAX;
+            hi[c] = INT64_MIN;
+        }
+    }
+    ~ColumnarWriter() {
+        for (int c=0; c < N_COLUMNS; c++) if (spill[c]) fclose(spill[c]);
+    }
+
+    void Event(uint64_t frame, int32_t evcode, int32_t add, int32_t det_id,
+               int32_t time_stamp, int32_t data) {
+        if (used == spill_count) Spill();
+        int64_t v[N_COLUMNS] = { (int64_t)frame, evcode, add, det_id, time_stamp, data };
+        for (int c=0; c < N_COLUMNS; c++) {
+            if (v[c] < lo[c]) lo[c] = v[c];
+            if (v[c] > hi[c]) hi[c] = v[c];
+        }
+        frame_buf[used] = frame;
+        field_buf[COL_EVCODE - 1][used] = (int16_t)evcode;
+        field_buf[COL_ADD - 1][used] = (int16_t)add;
+        field_buf[COL_DETID - 1][used] = (int16_t)det_id;
+        field_buf[COL_TIMESTAMP - 1][used] = (int16_t)time_stamp;
+        data_buf[used] = (uint16_t)data;
+        used++;
+        n_events++;
+    }
+
+    // write header and columns to the output (see Failed())
+    void Finish() {
+        Spill();
+        // (a value outside its spill width would have been cut short)
+        for (int c=COL_EVCODE; c < COL_DATA; c++) {
+            if (n_events && (lo[c] < INT16_MIN || hi[c] > INT16_MAX)) failed = true;
+        }
+        if (n_events && (lo[COL_DATA] < 0 || hi[COL_DATA] > UINT16_MAX)) failed = true;
+        if (failed) return;
+
+        ColumnarHeader header;
+        ColumnarEntry  entries[N_COLUMNS];
+        memset(&header, 0, sizeof(header));
+        memset(entries, 0, sizeof(entries));
+        memcpy(header.magic, columnar_magic, sizeof(columnar_magic));
+        header.version = columnar_version;
+        header.n_columns = N_COLUMNS;
+        header.n_events = n_events;
+        header.header_size = sizeof(header) + sizeof(entries);
+        header.align = column_align;
+
+        uint64_t offset = Align(header.header_size);
+        for (int c=0; c < N_COLUMNS; c++) {
+            strncpy(entries[c].name, column_names[c], sizeof(entries[c].name));
+            entries[c].type = n_events ? NarrowestType(lo[c], hi[c]) : (uint32_t)COLTYPE_UINT8;
+            entries[c].offset = offset;
+            entries[c].size = n_events * ColumnWidth(entries[c].type);
+            offset = Align(offset + entries[c].size);
+        }
+
+        uint64_t written = 0;
+        failed = !Put(&header, sizeof(header), written) || !Put(entries, sizeof(entries), written);
+        for (int c=0; c < N_COLUMNS && !failed; c++) {
+            failed = !Pad(entries[c].offset, written) || !CopyColumn(c, entries[c].type, written);
+        }
+    }
+
+    // true if a spill file could not be made or written, or writing the
+    //   output failed: the output is incomplete
+    bool Failed() const { return failed; }
+
+private:
+    int         fd;
+    FILE        *spill[N_COLUMNS];          // values at their spill width
+    uint64_t    frame_buf[spill_count];
+    int16_t     field_buf[4][spill_count];  // evcode / add / det_id / time_stamp
+    uint16_t    data_buf[spill_count];
+    int64_t     lo[N_COLUMNS], hi[N_COLUMNS];
+    uint64_t    n_events;
+    size_t      used;
+    bool        failed;
+
+    static uint64_t Align(uint64_t n) { return (n + column_align - 1) / column_align * column_align; }
+
+    // bytes per spilled value of column "c"
+    static size_t SpillWidth(int c) {
+        return (c == COL_FRAME) ? sizeof(uint64_t) : (c == COL_DATA) ? sizeof(uint16_t)
+                                                                     : sizeof(int16_t);
+    }
+
+    void Spill() {
+        for (int c=0; c < N_COLUMNS && !failed; c++) {
+            const void *buf = (c == COL_FRAME) ? (const void *)frame_buf
+                            : (c == COL_DATA)  ? (const void *)data_buf
+                                               : (const void *)field_buf[c - 1];
+            if (fwrite(buf, SpillWidth(c), used, spill[c]) != used) failed = true;
+        }
+        used = 0;
+    }
+
+    // value "i" of a block read back from the spill file of column "c"
+    static int64_t SpillValue(int c, const uint8_t *in, size_t i) {
+        if (c == COL_FRAME) {
+            uint64_t v;
+            memcpy(&v, in + i * sizeof(v), sizeof(v));
+            return (int64_t)v;
+        }
+        if (c == COL_DATA) {
+            uint16_t v;
+            memcpy(&v, in + i * sizeof(v), sizeof(v));
+            return v;
+        }
+        int16_t v;
+        memcpy(&v, in + i * sizeof(v), sizeof(v));
+        return v;
+    }
+
+    bool Put(const void *data, size_t len, uint64_t &written) {
+        written += len;
+        return WriteAll(fd, data, len);
+    }
+
+    bool Pad(uint64_t to, uint64_t &written) {
+        static const char zeros[column_align] = {0};
+        return Put(zeros, to - written, written);
+    }
+
+    // narrow one spilled column to "type" and append it to the output
+    bool CopyColumn(int c, uint32_t type, uint64_t &written) {
+        rewind(spill[c]);
+        uint32_t width = ColumnWidth(type);
+        uint8_t in [spill_count * sizeof(uint64_t)];
+        uint8_t out [spill_count * sizeof(uint64_t)];
+        size_t n;
+        while ((n = fread(in, SpillWidth(c), spill_count, spill[c])) > 0) {
+            for (size_t i=0; i < n; i++) {
+                // little-endian truncation of the two's complement value
+                uint64_t v = (uint64_t)SpillValue(c, in, i);
+                for (uint32_t b=0; b < width; b++) out[i*width + b] = (uint8_t)(v >> (8*b));
+            }
+            if (!Put(out, n * width, written)) return false;
+        }
+        return true;
+    }
+
+    ColumnarWriter(const ColumnarWriter &);
+    ColumnarWriter &operator=(const ColumnarWriter &);
+};
+
+
+// memory-mapped reader; columns are used in place, without any parsing
+class ColumnarReader {
+public:
+    ColumnarReader() : map(NULL), map_len(0), header(NULL), entries(NULL) {}
+    ~ColumnarReader() { Close(); }
+
+    // map "path" and validate its header; returns false if not a
+    //   readable columnar event list
+    bool Open(const char *path) {
+        Close();
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) return false;
+        struct stat results;
+        if (fstat(fd, &results) == 0 && results.st_size >= (off_t)sizeof(ColumnarHeader)) {
+            map_len = results.st_size;
+            void *p = mmap(NULL, map_len, PROT_READ, MAP_SHARED, fd, 0);
+            if (p != MAP_FAILED) map = (const uint8_t *)p;
+        }
+        close(fd);
+        if (!map || !Valid()) { Close(); return false; }
+        return true;
+    }
+
+    void Close() {
+        if (map) munmap((void *)map, map_len);
+        map = NULL; map_len = 0; header = NULL; entries = NULL;
+    }
+
+    uint64_t NEvents() const { return header->n_events; }
+    uint32_t Type(int c) const { return entries[c].type; }
+    const char *Name(int c) const { return entries[c].name; }
+
+    // start of column "c" (interpret according to Type(c))
+    const void *Column(int c) const { return map + entries[c].offset; }
+
+    // value "i" of column "c", widened to 64 bits
+    int64_t Value(int c, uint64_t i) const {
+        const uint8_t *p = (const uint8_t *)Column(c);
+        switch (entries[c].type) {
+            case COLTYPE_UINT8:  return p[i];
+            case COLTYPE_UINT16: return ((const uint16_t *)p)[i];
+            case COLTYPE_UINT32: return ((const uint32_t *)p)[i];
+            case COLTYPE_UINT64: return (int64_t)((const uint64_t *)p)[i];
+            case COLTYPE_INT8:   return ((const int8_t *)p)[i];
+            case COLTYPE_INT16:  return ((const int16_t *)p)[i];
+            case COLTYPE_INT32:  return ((const int32_t *)p)[i];
+            default:             return ((const int64_t *)p)[i];
+        }
+    }
+
+private:
+    const uint8_t           *map;
+    uint64_t                map_len;
+    const ColumnarHeader    *header;
+    const ColumnarEntry     *entries;
+
+    // (every column must be of a known type and lie within the file, so
+    //   that Value() never reads outside the mapping)
+    bool Valid() {
+        if (map_len < sizeof(ColumnarHeader) + N_COLUMNS * sizeof(ColumnarEntry)) return false;
+        header = (const ColumnarHeader *)map;
+        if (memcmp(header->magic, columnar_magic, sizeof(columnar_magic)) != 0) return false;
+        if (header->version != columnar_version || header->n_columns != N_COLUMNS) return false;
+        entries = (const ColumnarEntry *)(map + sizeof(ColumnarHeader));
+        for (int c=0; c < N_COLUMNS; c++) {
+            const ColumnarEntry &e = entries[c];
+            if (!ColumnTypeKnown(e.type)) return false;
+            uint64_t w = ColumnWidth(e.type);
+            if (header->n_events > UINT64_MAX / w || e.size != header->n_events * w) return false;
+            if (e.offset % w != 0 || e.offset > map_len || e.size > map_len - e.offset) return false;
+        }
+        return true;
+    }
+
+    ColumnarReader(const ColumnarReader &);
+    ColumnarReader &operator=(const ColumnarReader &);
+};
+
+#endif
@@ -0,0 +1,347 @@
+//
+// stein_compare.cpp -- C++ code to check the flight software against the
+// instrument: an FSW dump and a raw capture of the same data collection
+// are decoded side by side and their spectra compared, as EX_PLOT_RAW /
+// EX_PLOT_FSW (scripts/dusty/stein_simfsw.pro) do by overplotting them in
+// IDL.  Compiles with g++.  If compiled binary has name "stein_compare",
+// then usage on a UNIX machine is:
+//
+//    ./stein_compare [options] STEINBYTESLOG.log STEIN_RAWBYTESLOG.log > compare.txt
+//
+// Both files are decoded at once, sharing the threads of one work-stealing
+//  TaskPool (stein_pipeline.h), and each is reduced as it is decoded to
+//  spectra by (EVCODE, ADD, DET_ID) (a HistogramSink, stein_histogram.h);
+//  no event list is written or held.  The raw capture is decoded as with
+//  "rawstein_extract --simulate-fsw", so its EVCODE 0 DATA is log-binned
+//  to the same 128 bins as the FSW's.  Either file may be compressed.
+//
+// Output: one line per DET_ID (and DET_ID -1 for all of them together)
+//  comparing the EVCODE 0 spectra, after comment lines with the event
+//  counts of the other EVCODEs (which the FSW does not log-bin):
+//
+//    # DET_ID / FSW_COUNTS / RAW_COUNTS / NORM_DIFF / CHI2 / DOF / WORST_BIN / WORST_SIGMA
+//    4 18211 18344 -0.696 121.507 117 37 2.913
+//
+//    NORM_DIFF     (FSW - RAW) / sqrt(FSW + RAW): the count difference in
+//                  standard deviations
+//    CHI2, DOF     two-sample chi-square of the spectral shapes (each
+//                  spectrum scaled to the other's total), over the DOF + 1
+//                  bins holding counts; -1 and 0 if either has none
+//    WORST_BIN     the 7-bit bin whose share of the counts differs most,
+//    WORST_SIGMA   and by how many standard deviations (FSW - RAW)
+//
+// LOAD_EVENTLIST reads the table (as DblARR).  Options:
+//
+//    -j N, --jobs=N      decode on N threads in all (default 2; 0 = one per
+//                        CPU)
+//    --no-decompress     read both files as they are, even if they look
+//                        compressed
+//    --fsw-frames=A..B, --raw-frames=A..B
+//                        compare only these event frames of either file
+//                        (e.g. to leave out a bad start of the FSW dump, as
+//                        EX_PLOT_RAW masks its first 2.1e5 entries)
+//    --spectra=FILE      also write the aligned spectra: DET_ID / BIN / KEV
+//                        / FSW / RAW, one line per bin
+//    --max-chi2=X        exit with status 2 if any detector's CHI2 / DOF
+//                        exceeds X (for automatic regression checks)
+//    --max-sigma=S       likewise, if any detector's |NORM_DIFF| exceeds S
+//                        (events lost or gained, whatever their spectrum)
+//
+//
+// Copyright 2013 Karl Yando
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <atomic>
+#include <iostream>
+#include <math.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+using namespace std;
+
+#include "stein_filter.h"
+#include "stein_fsw.h"
+#include "stein_histogram.h"
+#include "stein_input.h"
+#include "stein_layout.h"
+#include "stein_options.h"
+#include "stein_output.h"
+#include "stein_pipeline.h"
+#include "stein_raw.h"
+
+static const int n_log_bins = 128;      // (7-bit EVCODE 0 DATA)
+static const int n_dets = 32;
+
+// one of the two data files, and its spectra
+struct CompareSource {
+    const char          *path;
+    const ChunkDecoder  *decoder;
+    HistogramSink       spectra;
+    uint64_t            n_frames;
+    bool                opened;
+    bool                failed;         // (decompressor error)
+    bool                decompress;
+
+    CompareSource(const char *path, const ChunkDecoder *decoder, bool decompress)
+        : path(path), decoder(decoder), spectra(-1), n_frames(0), opened(false), failed(false),
+          decompress(decompress) {}
+
+    // EVCODE 0 counts of "det_id" (-1: every DET_ID) in 7-bit bin "bin"
+    uint64_t Count(int det_id, int bin) const {
+        if (det_id < 0) {
+            uint64_t n = 0;
+            for (int d=0; d < n_dets; d++) n += Count(d, bin);
+            return n;
+        }
+        const vector<uint64_t> &bins = spectra.Bins(0, -1, det_id);
+        return ((size_t)bin < bins.size()) ? bins[bin] : 0;
+    }
+
+    // all events of "evcode"
+    uint64_t Total(int evcode) const {
+        uint64_t n = 0;
+        for (int add=-1; add <= 1; add++) {
+            for (int det=-1; det < n_dets; det++) {
+                const vector<uint64_t> &bins = spectra.Bins(evcode, add, det);
+                for (size_t b=0; b < bins.size(); b++) n += bins[b];
+            }
+        }
+        return n;
+    }
+};
+
+// decode "source" as thread "self" of "pool"
+static void DecodeSource(TaskPool *pool, unsigned self, CompareSource *source) {
+    InputSource input;
+    if (!input.Open(source->path, false, source->decompress)) return;
+    source->opened = true;
+    DecodePipeline pipeline(*source->decoder, source->spectra, pool->Size());
+    pipeline.SetTaskPool(pool, self);
+    source->n_frames = pipeline.Run(input);
+    source->failed = input.Failed();
+}
+
+// one pool thread: threads 0 and 1 decode a file each; all of them help
+//   with the chunks of both until the files are done
+static void CompareWork(TaskPool *pool, unsigned self, CompareSource *sources[2],
+                        atomic<int> *n_left) {
+    if (self < 2) {
+        DecodeSource(pool, self, sources[self]);
+        if (--*n_left == 0) pool->Stop();
+    }
+    while (true) {
+        if (pool->RunOne(self)) continue;
+        if (!pool->Wait()) return;
+    }
+}
+
+// the comparison of the EVCODE 0 spectra of one DET_ID (-1: all)
+struct DetComparison {
+    uint64_t    fsw, raw;
+    double      norm_diff;
+    double      chi2;
+    int         dof;
+    int         worst_bin;
+    double      worst_sigma;
+};
+
+static DetComparison CompareDet(const CompareSource &fsw, const CompareSource &raw, int det_id) {
+    DetComparison c = { 0, 0, 0, -1, 0, -1, 0 };
+    uint64_t f [n_log_bins], r [n_log_bins];
+    for (int b=0; b < n_log_bins; b++) {
+        c.fsw += f[b] = fsw.Count(det_id, b);
+        c.raw += r[b] = raw.Count(det_id, b);
+    }
+    if (c.fsw + c.raw) c.norm_diff = ((double)c.fsw - (double)c.raw) / sqrt((double)(c.fsw + c.raw));
+    if (c.fsw == 0 || c.raw == 0) return c;
+
+    // two-sample chi-square for unequal totals (Numerical Recipes "chstwo")
+    double F = (double)c.fsw, R = (double)c.raw;
+    double kf = sqrt(R / F), kr = sqrt(F / R);
+    double worst = -1;
+    c.chi2 = 0;
+    for (int b=0; b < n_log_bins; b++) {
+        if (f[b] + r[b] == 0) continue;
+        double d = kf * f[b] - kr * r[b];
+        c.chi2 += d * d / (double)(f[b] + r[b]);
+        c.dof++;
+        double sigma = (f[b] / F - r[b] / R) / sqrt(f[b] / (F * F) + r[b] / (R * R));
+        if (fabs(sigma) > worst) {
+            worst = fabs(sigma);
+            c.worst_bin = b;
+            c.worst_sigma = sigma;
+        }
+    }
+    c.dof--;                            // (the totals are matched)
+    return c;
+}
+
+// write the aligned spectra to "path"; returns false on failure
+static bool WriteSpectra(const char *path, const CompareSource &fsw, const CompareSource &raw) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+    EventWriter out(fd, 1 << 16);
+    out.Write("# DET_ID / BIN / KEV / FSW / RAW\n");
+    for (int det=0; det < n_dets; det++) {
+        bool any = false;
+        for (int b=0; b < n_log_bins && !any; b++) any = fsw.Count(det, b) || raw.Count(det, b);
+        if (!any) continue;
+        for (int b=0; b < n_log_bins; b++) {
+            char line [max_event_line];
+            char *p = FormatSigned(line, det);                  *p++ = ' ';
+            p = FormatSigned(p, b);                             *p++ = ' ';
+            p = FormatSigned(p, fsw_log.kev[b]);                *p++ = ' ';
+            p = FormatUnsigned(p, fsw.Count(det, b));           *p++ = ' ';
+            p = FormatUnsigned(p, raw.Count(det, b));           *p++ = '\n';
+            out.Write(line, p - line);
+        }
+    }
+    out.Flush();
+    bool ok = !out.Failed();
+    return (close(fd) == 0) && ok;
+}
+
+
+int main(int argc, char *argv[]) {
+    const char *fileNames[2] = { NULL, NULL };      // FSW dump, raw capture
+    int n_files = 0;
+    SteinOptions opts;
+    opts.threads = 2;
+    EventFilter frames[2];
+    const char *spectraName = NULL;
+    double max_chi2 = -1, max_sigma = -1;
+
+    // parse command-line arguments
+    for (int i=1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value;
+        if (strncmp(arg, "-j", 2) == 0 || strncmp(arg, "--jobs=", 7) == 0
+                || strcmp(arg, "--no-decompress") == 0) {
+            int used = ParseCommonOption(argc, argv, i, opts);
+            if (used < 0) return 1;             // (malformed option)
+            i += used - 1;
+        } else if ((value = OptionValue(arg, "--fsw-frames"))
+                   || (value = OptionValue(arg, "--raw-frames"))) {
+            EventFilter &range = (strncmp(arg, "--raw", 5) == 0) ? frames[1] : frames[0];
+            if (!range.SetFrames(value)) {
+                cerr << "invalid frame range: " << value << "\n";
+                return 1;
+            }
+        } else if ((value = OptionValue(arg, "--spectra"))) {
+            spectraName = value;
+        } else if ((value = OptionValue(arg, "--max-chi2"))
+                   || (value = OptionValue(arg, "--max-sigma"))) {
+            char *end;
+            double limit = strtod(value, &end);
+            if (*value < '0' || *value > '9' || *end != '\0') {
+                cerr << "invalid limit: " << arg << "\n";
+                return 1;
+            }
+            if (strncmp(arg, "--max-chi2", 10) == 0) max_chi2 = limit; else max_sigma = limit;
+        } else if (arg[0] == '-' && arg[1] != '\0') {
+            cerr << "unknown option: " << arg << "\n";
+            return 1;
+        } else if (n_files < 2) {
+            fileNames[n_files++] = arg;
+        }
+    }
+    if (n_files != 2) {
+        cerr << "usage: " << argv[0] << " [-j N] [--fsw-frames=A..B] [--raw-frames=A..B]"
+             << " [--no-decompress] [--spectra=FILE] [--max-chi2=X] [--max-sigma=S] <FSW dump> <raw data>\n";
+        return 1;
+    }
+
+    // decode both at once (the raw data as the FSW would have sent it)
+    FswPacketDecoder fsw_decoder;
+    RawRecordDecoder raw_decoder(true);
+    if (frames[0].Active()) fsw_decoder.SetFilter(&frames[0]);
+    if (frames[1].Active()) raw_decoder.SetFilter(&frames[1]);
+    CompareSource fsw(fileNames[0], &fsw_decoder, opts.decompress);
+    CompareSource raw(fileNames[1], &raw_decoder, opts.decompress);
+    CompareSource *sources[2] = { &fsw, &raw };
+
+    unsigned n_threads = (opts.threads > 2) ? opts.threads : 2;
+    TaskPool pool(n_threads);
+    atomic<int> n_left(2);
+    vector<thread> threads;
+    for (unsigned t=0; t < n_threads; t++) {
+        threads.push_back(thread(CompareWork, &pool, t, sources, &n_left));
+    }
+    for (size_t t=0; t < threads.size(); t++) threads[t].join();
+
+    for (int k=0; k < 2; k++) {
+        if (!sources[k]->opened) {
+            cerr << "cannot read " << sources[k]->path << "\n";
+            return 1;
+        }
+        if (sources[k]->failed) {
+            cerr << "read of " << sources[k]->path
+                 << " failed (corrupt or truncated compressed data?)\n";
+            return 1;
+        }
+    }
+
+    // the comparison
+    EventWriter out(1);
+    char line [256];
+    out.Write(("# usage: " + string(argv[0]) + " <FSW dump> <raw data>\n").c_str());
+    snprintf(line, sizeof(line), "# fsw: %s (%llu frames)\n# raw: %s (%llu frames;"
+             " --simulate-fsw)\n", fsw.path, (unsigned long long)fsw.n_frames,
+             raw.path, (unsigned long long)raw.n_frames);
+    out.Write(line);
+    for (int evcode=1; evcode < 4; evcode++) {
+        snprintf(line, sizeof(line), "# EVCODE %d: fsw %llu raw %llu events\n", evcode,
+                 (unsigned long long)fsw.Total(evcode), (unsigned long long)raw.Total(evcode));
+        out.Write(line);
+    }
+    out.Write("# EVCODE 0 spectra, 7-bit log bins (DET_ID -1: all detectors)\n");
+    out.Write("# DET_ID / FSW_COUNTS / RAW_COUNTS / NORM_DIFF / CHI2 / DOF / WORST_BIN"
+              " / WORST_SIGMA\n");
+    string over, off;
+    for (int det=0; det <= n_dets; det++) {
+        int det_id = (det < n_dets) ? det : -1;
+        DetComparison c = CompareDet(fsw, raw, det_id);
+        if (c.fsw + c.raw == 0 && det_id >= 0) continue;
+        snprintf(line, sizeof(line), "%d %llu %llu %.3f %.3f %d %d %.3f\n", det_id,
+                 (unsigned long long)c.fsw, (unsigned long long)c.raw, c.norm_diff,
+                 c.chi2, c.dof, c.worst_bin, c.worst_sigma);
+        out.Write(line);
+        if (max_chi2 >= 0 && det_id >= 0 && c.dof > 0 && c.chi2 / c.dof > max_chi2) {
+            over += " " + to_string(det_id);
+        }
+        if (max_sigma >= 0 && det_id >= 0 && fabs(c.norm_diff) > max_sigma) {
+            off += " " + to_string(det_id);
+        }
+    }
+    out.Flush();
+    if (out.Failed()) {
+        cerr << "write to standard out failed\n";
+        return 1;
+    }
+    if (spectraName && !WriteSpectra(spectraName, fsw, raw)) {
+        cerr << "cannot write " << spectraName << "\n";
+        return 1;
+    }
+    if (!over.empty()) cerr << "# CHI2 / DOF above " << max_chi2 << " for DET_ID" << over << "\n";
+    if (!off.empty()) cerr << "# |NORM_DIFF| above " << max_sigma << " for DET_ID" << off << "\n";
+    if (!over.empty() || !off.empty()) return 2;
+    return 0;
+}
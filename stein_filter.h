@@ -0,0 +1,135 @@
+//
+// stein_filter.h -- event filters applied by the decoders ("--evcode",
+//  "--add", "--det-id", "--time-stamp", "--frames"), so that events a run
+//  does not want are dropped as soon as they are decoded, and are never
+//  formatted or written.  This is GET_SUBSET (stein_actions.pro) moved in
+//  front of the output.
+//
+// EVCODE, ADD and DET_ID take sets of values, each a comma-separated list
+//  of values and inclusive "A..B" ranges (e.g. "--det-id=0..7,12"; -1 is
+//  the value of a field the event type does not carry).  TIME_STAMP and
+//  frame take one inclusive range, either end of which may be left open
+//  ("--frames=19800..", "--time-stamp=..31").  An event is kept if it
+//  passes every filter given.
+//
+// The sets are compiled to one bitmask per field, so the test is three
+//  shifts, an AND and two range compares per event.  Decoders also ask
+//  whether a frame range can hold any wanted event at all, and skip
+//  packets / records outside the --frames range without parsing them.
+//
+//
+// Copyright 2013 Karl Yando
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef STEIN_FILTER_H
+#define STEIN_FILTER_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+class EventFilter {
+public:
+    EventFilter() : active(false), evcodes(0xf), adds(0x7), det_ids(~0ULL),
+                    ts_lo(INT32_MIN), ts_hi(INT32_MAX), frame_lo(0), frame_hi(UINT64_MAX) {}
+
+    // true once any filter has been set
+    bool Active() const { return active; }
+
+    // set one filter from its option value; returns false if malformed
+    bool SetEvcodes(const char *text)    { return ParseSet(text, 0, 3, evcodes); }
+    bool SetAdds(const char *text)       { return ParseSet(text, -1, 1, adds); }
+    bool SetDetIds(const char *text)     { return ParseSet(text, -1, 31, det_ids); }
+    bool SetTimeStamps(const char *text) {
+        int64_t lo, hi;
+        if (!ParseRange(text, -1, 65535, lo, hi) || *text != '\0') return false;
+        ts_lo = (int32_t)lo; ts_hi = (int32_t)hi;
+        return (active = true);
+    }
+    bool SetFrames(const char *text) {
+        int64_t lo, hi;
+        if (!ParseRange(text, 0, INT64_MAX, lo, hi) || *text != '\0') return false;
+        frame_lo = (uint64_t)lo; frame_hi = (uint64_t)hi;
+        return (active = true);
+    }
+
+    // does the event pass? (ADD -1..1, DET_ID -1..31, as decoded)
+    inline bool Pass(uint64_t frame, int32_t evcode, int32_t add, int32_t det_id,
+                     int32_t time_stamp) const {
+        uint64_t keep = (evcodes >> evcode) & (adds >> (add + 1)) & (det_ids >> (det_id + 1));
+        return (keep & 1) && time_stamp >= ts_lo && time_stamp <= ts_hi
+                          && frame >= frame_lo && frame <= frame_hi;
+    }
+
+    // can any of frames [first, first + n) pass?
+    inline bool AnyFrame(uint64_t first, uint64_t n) const {
+        return first <= frame_hi && first + n > frame_lo;
+    }
+
+    // a comma-separated list of values and "A..B" ranges, all within
+    //   [min, max] (at most 64 values), into the bitmask "set" (bit
+    //   "value - min"); returns false if malformed
+    static bool ParseValueSet(const char *text, int64_t min, int64_t max, uint64_t &set) {
+        set = 0;
+        while (true) {
+            int64_t lo, hi;
+            if (!ParseRange(text, min, max, lo, hi)) return false;
+            for (int64_t v=lo; v <= hi; v++) set |= 1ULL << (v - min);
+            if (*text == '\0') break;
+            if (*text++ != ',') return false;
+        }
+        return true;
+    }
+
+private:
+    bool        active;
+    uint64_t    evcodes;                // (bit "EVCODE")
+    uint64_t    adds;                   // (bit "ADD + 1")
+    uint64_t    det_ids;                // (bit "DET_ID + 1")
+    int32_t     ts_lo, ts_hi;
+    uint64_t    frame_lo, frame_hi;
+
+    // one "V", "A..B", "A.." or "..B" item at "text" (ends default to
+    //   "min" / "max"); advances "text" past it
+    static bool ParseRange(const char *&text, int64_t min, int64_t max,
+                           int64_t &lo, int64_t &hi) {
+        char *end = (char *)text;
+        lo = min; hi = max;
+        bool open_lo = (text[0] == '.' && text[1] == '.');
+        if (!open_lo) {
+            lo = strtoll(text, &end, 10);
+            if (end == text) return false;
+            text = end;
+        }
+        if (text[0] == '.' && text[1] == '.') {
+            text += 2;
+            if (*text != '\0' && *text != ',') {
+                hi = strtoll(text, &end, 10);
+                if (end == text) return false;
+                text = end;
+            } else if (open_lo) {
+                return false;           // (".." alone)
+            }
+        } else {
+            hi = lo;
+        }
+        return lo >= min && hi <= max && lo <= hi;
+    }
+
+    bool ParseSet(const char *text, int64_t min, int64_t max, uint64_t &set) {
+        return ParseValueSet(text, min, max, set) && (active = true);
+    }
+};
+
+#endif
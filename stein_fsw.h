@@ -0,0 +1,341 @@
+//
+// stein_fsw.h -- the packet layout of CINEMA flight software (FSW) dumps,
+//  and FswPacketDecoder, which turns lines of "0xNN, " packet bytes into
+//  events.  Used by fsw_steinunpack.cpp and by the decoding library
+//  (stein_capi.cpp).
+//
+//
+// Copyright 2013 Karl Yando
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef STEIN_FSW_H
+#define STEIN_FSW_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "stein_hexparse.h"
+#include "stein_kernel.h"
+#include "stein_output.h"
+#include "stein_pipeline.h"
+#include "stein_quarantine.h"
+#include "stein_stats.h"
+
+// DATA PACKET PARAMETERS
+const uint16_t packet_size = 512;      // size (BYTES) of one packet of FSW data
+// NOTE: the packet *usually* occupies 518-bytes; the CCSDS header has been stripped here
+const uint16_t ccsds_size = 0;         // size (BYTES) of CCSDS header
+// NOTE: the CCSDS header *usually* occupies 6-bytes; it has been stripped here
+const uint16_t packetheader_size = 1;  // size (BYTES) of packet header (e.g. "0xAF" for STEIN)
+const uint16_t timestamp_size = 6;     // size (BYTES) of packet timestamp
+const uint16_t steinframe_size = 495;  // size (BYTES) of STEIN packet data subframe
+const uint16_t housekeep_size = 8;     // size (BYTES) of packet housekeeping subframe
+const uint16_t sparebyte_size = 2;     // size (BYTES) of packet unused bytes
+// NOTE: the observed packet size is actually 514 bytes; the final 2 bytes are spurious
+//
+const uint16_t event_cnt = 198;       // size (# STEIN EVENTS) in one packet of FSW data
+const uint8_t stein_header = 0xAF;    // packet header byte of STEIN packets
+
+
+// PACKET VALIDATION
+// every packet line is checked before it is decoded: at least packet_size
+//   tokens, each a well-formed "0xNN," hex byte, and the STEIN header
+//   byte.  Optionally ("--packet-tokens=N", "--check-spare") the exact
+//   number of tokens on the line, and zero spare bytes.  A packet that
+//   fails is skipped -- its frame numbers stay unused -- and copied to the
+//   quarantine file ("--quarantine=FILE"; see stein_quarantine.h).
+struct PacketChecks {
+    size_t      n_tokens;               // tokens per line (0: any >= packet_size)
+    bool        zero_spare;             // spare bytes must be 0
+
+    PacketChecks() : n_tokens(0), zero_spare(false) {}
+};
+
+
+// PACKET TIME
+// the 6-byte timestamp is month (1-12), day (1-31), hour, minute, second
+//   and fraction of a second (1/256 s), one binary byte each ("mo / dy /
+//   hr / min / sec / fracsec" in fsw_steinunpack.pro); it holds no year.
+//   PacketTime turns it into the time since January 1, 00:00 of the dump's
+//   year, in 1/packet_time_ticks s.  Days are counted as in a leap year so
+//   that February 29 has a place and the time never runs backwards within
+//   a year (in a common year, times from March 1 on read one day late;
+//   differences within a day or a month are exact).  A month outside 1-12
+//   counts as January, and day 0 as day 1.  Events carry only a short,
+//   wrapping TIME_STAMP of their own; "--packet-time" adds the time of
+//   each event's packet to the event list, and "--housekeeping" /
+//   "--rates" write per-packet time series (see stein_timeseries.h).
+static_assert(packet_time_ticks == 256, "the timestamp fraction is 1/256 s");
+static constexpr uint16_t month_first_day [12] =       // (day of the leap year)
+    { 0, 31, 60, 91, 121, 152, 182, 213, 244, 274, 305, 335 };
+static const uint64_t packet_year_ticks = 366ull * 86400 * packet_time_ticks;
+
+constexpr uint64_t PacketTime(const uint8_t timestamp[]) {
+    uint8_t month = (timestamp[0] >= 1 && timestamp[0] <= 12) ? timestamp[0] : 1;
+    uint8_t day = timestamp[1] ? timestamp[1] : 1;
+    uint64_t days = month_first_day[month - 1] + day - 1;
+    uint64_t seconds = ((days * 24 + timestamp[2]) * 60 + timestamp[3]) * 60 + timestamp[4];
+    return seconds * packet_time_ticks + timestamp[5];
+}
+
+// the timestamp bytes of packet time "time" (taken modulo one leap year);
+//   the inverse of PacketTime, for synthetic dumps (stein_synth.h)
+inline void PacketTimestamp(uint64_t time, uint8_t timestamp[]) {
+    time %= packet_year_ticks;
+    timestamp[5] = (uint8_t)(time % packet_time_ticks);
+    uint64_t seconds = time / packet_time_ticks;
+    timestamp[4] = (uint8_t)(seconds % 60);
+    timestamp[3] = (uint8_t)(seconds / 60 % 60);
+    timestamp[2] = (uint8_t)(seconds / 3600 % 24);
+    uint32_t days = (uint32_t)(seconds / 86400);
+    uint8_t month = 12;
+    while (month_first_day[month - 1] > days) month--;
+    timestamp[0] = month;
+    timestamp[1] = (uint8_t)(days - month_first_day[month - 1] + 1);
+}
+
+// a packet stamped July 4, 14:30:45.25 is 185 days, 14 h 30 min 45.25 s
+//   into the year; February 29 and March 1 follow each other
+static constexpr uint8_t packet_time_check [3][6] = {
+    { 7, 4, 14, 30, 45, 64 }, { 2, 29, 23, 59, 59, 255 }, { 3, 1, 0, 0, 0, 0 } };
+static_assert(PacketTime(packet_time_check[0])
+              == ((185ull * 24 + 14) * 3600 + 30 * 60 + 45) * 256 + 64, "packet time");
+static_assert(PacketTime(packet_time_check[2]) - PacketTime(packet_time_check[1]) == 1,
+              "packet time across February 29");
+static_assert(PacketTime(packet_time_check[2]) == 60ull * 86400 * 256, "packet time");
+
+
+// STREAMING APPROACH
+// each line of the dump is a self-contained packet, so we decode one 
+//   line at a time, write its events out, and drop it.  Only a single
+//   packet's worth of storage is ever held per decoding thread, no matter
+//   how large the input file is, and the file is read exactly once.
+//   Lines are decoded in chunks (see stein_pipeline.h), which may be
+//   spread across threads with "-j N".
+class FswPacketDecoder : public ChunkDecoder {
+public:
+    // "checks": optional validation (see PacketChecks); rejected packets
+    //   go to "quarantine" (may be NULL)
+    explicit FswPacketDecoder(const PacketChecks &checks = PacketChecks(),
+                              Quarantine *quarantine = NULL)
+        : checks(checks), quarantine(quarantine), packet_info(false) {}
+
+    // announce every packet (time, housekeeping, rate counts) to the
+    //   output before its events (see PacketInfo, stein_output.h)
+    void SetPacketInfo(bool on) { packet_info = on; }
+
+    // chunks end after a newline (or at the end of the input)
+    size_t ChunkLength(const uint8_t *data, size_t avail, size_t want, bool at_eof) const {
+        return LineChunkLength(data, avail, want, at_eof);
+    }
+
+    // every non-blank line is one packet of event_cnt events (a packet
+    //   that fails validation keeps its frame numbers, but has no events)
+    uint64_t CountEvents(const uint8_t *data, size_t len, uint64_t &n_lines) const {
+        uint64_t n_packets = 0;
+        const uint8_t *end = data + len;
+        n_lines = 0;
+        while (data < end) {
+            const uint8_t *nl = (const uint8_t *)memchr(data, '\n', end - data);
+            const uint8_t *line_end = nl ? nl : end;
+            if (line_end - data > 1) n_packets++;
+            n_lines++;
+            data = line_end + 1;
+        }
+        return n_packets * event_cnt;
+    }
+
+    void Decode(const uint8_t *data, size_t len, uint64_t first_frame, uint64_t first_line,
+                EventSink &output, DecodeCounts *counts) const {
+        // per-packet storage (reused for every line)
+        uint8_t     packet_bytes [packet_size];             // bytes in one packet
+        // UNEXPLOITED QUANTITIES (extracted, but not presently treated)
+        //uint8_t     packet_ccsds [ccsds_size];
+        // NOTE: CCSDS data is stripped out in pre-processing, hence this array is NOT FILLED
+        // NOTE: the packet header byte is checked by CheckPacket(), then skipped
+        // NOTE: spare bytes in each frame are disregarded
+        // PACKET QUANTITIES (passed on with --packet-time, --housekeeping, --rates)
+        uint8_t     packet_timestamp [timestamp_size];
+        // NOTE: STEIN_FRAME is broken down further
+        uint8_t     packet_housekeeping [housekeep_size];
+        EventBatch  events;                                 // decoded STEIN frame
+        PacketInfo  info;
+
+        uint64_t current_event = first_frame;   // tracks absolute event number
+        uint64_t current_line = first_line;     // (for the quarantine file)
+        uint64_t n_written = 0;
+
+        const uint8_t *end = data + len;
+        while (data < end) {
+            // 
+            // get one line
+            const uint8_t *nl = (const uint8_t *)memchr(data, '\n', end - data);
+            const char *ascii_line = (const char *)data;
+            size_t line_len = (nl ? nl : end) - data;
+            data += line_len + 1;
+            current_line++;
+         
+            // does line contain data? 
+            if (line_len <= 1) continue;        // no; blank line
+            // is any of it wanted? (--frames; see stein_filter.h)
+            if (filter && !filter->AnyFrame(current_event, event_cnt)) {
+                current_event += event_cnt;
+                continue;
+            }
+            
+            // HEX EXTRACT
+            // convert the "0xNN," tokens straight into bytes, scanning the
+            //   line buffer in place (see stein_hexparse.h)
+            HexLineScan scan = ScanHexLine(ascii_line, line_len, packet_bytes, packet_size);
+
+            // VALIDATION
+            // a packet that is not what we expect is skipped (and copied to
+            //   the quarantine file), rather than decoded into garbage
+            char reason [80];
+            PacketFault fault = CheckPacket(scan, packet_bytes, reason);
+            if (fault != PACKET_OK) {
+                if (quarantine) quarantine->Add(current_line - 1, current_event / event_cnt,
+                                                reason, ascii_line, line_len);
+                if (counts) counts->Fault(fault);
+                current_event += event_cnt;
+                continue;
+            }
+
+            // HEX PARSE
+            //
+            uint16_t cursor = 0;            // byte-position cursor (for packet) 
+            // CCSDS (for usage, define "packet_ccsds" and set "ccsds_size" != 0)
+            //for (uint16_t i=0; i < ccsds_size; i++) {
+            //    packet_ccsds[i] = packet_bytes[cursor];
+            //    cursor++;
+            //}
+            // PACKET HEADER (already validated)
+            cursor += packetheader_size;
+            // PACKET TIMESTAMP
+            for (uint16_t i=0; i < timestamp_size; i++) {
+                packet_timestamp[i] = packet_bytes[cursor];
+                cursor++;
+            }
+            // ***********
+            // STEIN DATA 
+            //
+            // STEIN bytes are used where they sit in "packet_bytes" (no copy);
+            //   extract all events from these bytes and parse each into 
+            //   EVCODE, ADD, DETID, TIMESTAMP & EVENTDATA in one batch
+            //   (vectorized where the CPU allows; see stein_kernel.h)
+            UnpackFrame(packet_bytes + cursor, events);
+            cursor += steinframe_size;
+            if (counts) {                       // (--stats; see stein_stats.h)
+                counts->records++;
+                counts->events += event_cnt;
+                for (uint16_t i=0; i < event_cnt; i++) counts->Event(events.evcode[i], events.add[i], events.det_id[i]);
+            }
+            // HOUSEKEEPING
+            for (uint16_t i=0; i < housekeep_size; i++) {
+                packet_housekeeping[i] = packet_bytes[cursor];
+                cursor++;
+            }
+            // SPARE BYTES (UNIMPLEMENTED)
+            //
+            // the packet itself goes first, so its time can go with its
+            //   events (and into the time series)
+            if (packet_info) {
+                DescribePacket(current_event / event_cnt, packet_timestamp,
+                               packet_housekeeping, events, info);
+                output.Packet(info);
+            }
+            //
+            // write each event out immediately (nothing is retained),
+            //   unless it is filtered out
+            for (uint16_t i=0; i < event_cnt; i++) {
+                if (!filter || filter->Pass(current_event, events.evcode[i], events.add[i],
+                                            events.det_id[i], events.time_stamp[i])) {
+                    output.Event(current_event, events.evcode[i], events.add[i],
+                            events.det_id[i], events.time_stamp[i], events.data[i]);
+                    n_written++;
+                }
+                current_event++;
+            }
+            // NOTE: the cursor is NOT advanced inside the event loop (it already
+            //   sits past the STEIN frame); doing so ran it off the packet
+            //
+            // ***********
+        }
+        if (counts) counts->written += n_written;
+    }
+
+    // the first thing wrong with a packet ("reason" says what), if any;
+    //   also used by the --build-index pass
+    PacketFault CheckPacket(const HexLineScan &scan, const uint8_t packet_bytes[],
+                            char reason[80]) const {
+        if (scan.n_tokens < packet_size) {
+            snprintf(reason, 80, "short packet (%zu byte tokens)", scan.n_tokens);
+            return PACKET_SHORT;
+        }
+        if (scan.first_bad != SIZE_MAX) {
+            snprintf(reason, 80, "malformed token %zu (not \"0xNN,\")", scan.first_bad + 1);
+            return PACKET_MALFORMED;
+        }
+        if (packet_bytes[ccsds_size] != stein_header) {
+            snprintf(reason, 80, "header 0x%02X, not 0x%02X", packet_bytes[ccsds_size], stein_header);
+            return PACKET_HEADER;
+        }
+        if (checks.n_tokens && scan.n_tokens != checks.n_tokens) {
+            snprintf(reason, 80, "%zu byte tokens, not %zu", scan.n_tokens, checks.n_tokens);
+            return PACKET_LENGTH;
+        }
+        if (checks.zero_spare) {
+            uint16_t spare = packet_size - sparebyte_size;
+            for (uint16_t i=spare; i < packet_size; i++) {
+                if (packet_bytes[i] == 0) continue;
+                snprintf(reason, 80, "spare byte %u is 0x%02X, not 0", i, packet_bytes[i]);
+                return PACKET_SPARE;
+            }
+        }
+        return PACKET_OK;
+    }
+
+private:
+    PacketChecks    checks;
+    Quarantine      *quarantine;
+    bool            packet_info;
+
+    // the PacketInfo of packet number "packet": its time and housekeeping,
+    //   and what the rate engine counts -- EVCODE 0 events per DET_ID, and
+    //   the sweep reports (EVCODE 1: triggers/s, EVCODE 2: events/s)
+    static void DescribePacket(uint64_t packet, const uint8_t timestamp[],
+                               const uint8_t housekeeping[], const EventBatch &events,
+                               PacketInfo &info) {
+        memset(&info, 0, sizeof(info));
+        info.packet = packet;
+        info.time = PacketTime(timestamp);
+        memcpy(info.housekeeping, housekeeping, housekeep_size);
+        for (uint16_t i=0; i < event_cnt; i++) {
+            switch (events.evcode[i]) {
+            case 0:
+                info.det_events[events.det_id[i] & 31]++;
+                break;
+            case 1:
+            case 2:
+                info.sweep_sum[events.evcode[i] - 1] += events.data[i];
+                info.sweep_n[events.evcode[i] - 1]++;
+                break;
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,156 @@
+//
+// stein_gendata.cpp -- C++ code to write synthetic STEIN input files of any
+// size, for benchmarks and tests of (1A) and (1B) without a real capture.
+// Compiles with g++.  If compiled binary has name "stein_gendata", then
+// usage on a UNIX machine is:
+//
+//    ./stein_gendata --format=fsw --count=N [options] [output file]
+//
+// where "--format" is "fsw" (ASCII hex dump of 512-byte FSW packets, as
+//  read by fsw_steinunpack), "raw" (packed 4-byte binary records, as read
+//  by rawstein_extract) or "sub20" (SUB-20 log text, as read by
+//  "rawstein_extract --sub20"), and "N" is the number of packets (fsw) or
+//  records (raw, sub20).  Without an output file the data go to standard
+//  out.  The output depends only on the options, so runs repeat exactly:
+//
+//    --seed=S                  generator seed (default 1)
+//    --evcode-mix=W0,W1,W2,W3  relative frequency of EVCODE 0..3
+//                              (default 80,5,5,10)
+//    --add-mix=W0,W1           relative frequency of ADD 0 / 1 (default 1,1)
+//    --det-ids=SET             DET_ID values to use, e.g. "0..7,12"
+//
+//    ./stein_gendata --format=fsw --count=100000 --evcode-mix=1,0,0,0 big.log
+//
+// (see stein_synth.h for the generated fields)
+//
+//
+// Copyright 2013 Karl Yando
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <iostream>
+#include <string>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+using namespace std;
+
+#include "stein_output.h"
+#include "stein_synth.h"
+
+enum SynthFormat { SYNTH_FSW, SYNTH_RAW, SYNTH_SUB20 };
+
+// output is collected in a large buffer and written in whole blocks
+static const size_t out_buffer_size = 1 << 20;
+
+
+int main(int argc, char *argv[]) {
+    const char *fileName = NULL;
+    SynthFormat format = SYNTH_FSW;
+    bool have_format = false;
+    uint64_t count = 0;
+    uint64_t seed = 1;
+    SynthMix mix;
+
+    // parse command-line arguments
+    for (int i=1; i < argc; i++) {
+        const char *arg = argv[i];
+        int used = ParseMixOption(arg, mix);
+        if (used < 0) return 1;                 // (malformed option)
+        if (used > 0) continue;
+        char *end;
+        if (strncmp(arg, "--format=", 9) == 0) {
+            const char *value = arg + 9;
+            if (strcmp(value, "fsw") == 0) format = SYNTH_FSW;
+            else if (strcmp(value, "raw") == 0) format = SYNTH_RAW;
+            else if (strcmp(value, "sub20") == 0) format = SYNTH_SUB20;
+            else {
+                cerr << "unknown format: " << value << " (fsw, raw or sub20)\n";
+                return 1;
+            }
+            have_format = true;
+        } else if (strncmp(arg, "--count=", 8) == 0) {
+            count = strtoull(arg + 8, &end, 10);
+            if (arg[8] < '0' || arg[8] > '9' || *end != '\0') {
+                cerr << "invalid count: " << arg + 8 << "\n";
+                return 1;
+            }
+        } else if (strncmp(arg, "--seed=", 7) == 0) {
+            seed = strtoull(arg + 7, &end, 10);
+            if (arg[7] < '0' || arg[7] > '9' || *end != '\0') {
+                cerr << "invalid seed: " << arg + 7 << "\n";
+                return 1;
+            }
+        } else if (arg[0] == '-' && arg[1] != '\0') {
+            cerr << "unknown option: " << arg << "\n";
+            return 1;
+        } else if (fileName == NULL) {
+            fileName = arg;
+        }
+    } // ignore any subsequent file names
+    if (!have_format || count == 0) {
+        cerr << "usage: " << argv[0] << " --format=fsw|raw|sub20 --count=N [--seed=S]"
+             << " [--evcode-mix=W0,W1,W2,W3] [--add-mix=W0,W1] [--det-ids=SET]"
+             << " [output file]\n";
+        return 1;
+    }
+
+    int fd = 1;
+    if (fileName && strcmp(fileName, "-") != 0) {
+        fd = open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            cerr << "cannot write " << fileName << "\n";
+            return 1;
+        }
+    }
+
+    SynthGenerator generator(seed, mix);
+    char *buffer = new char [out_buffer_size + synth_max_fsw_line];
+    size_t used = 0;
+    bool ok = true;
+    uint8_t packet [synth_packet_bytes];
+    uint8_t record [4];
+    for (uint64_t n=0; n < count && ok; n++) {
+        switch (format) {
+        case SYNTH_FSW:
+            generator.FswPacket(n, packet);
+            used += SynthGenerator::FswLine(packet, buffer + used);
+            break;
+        case SYNTH_RAW:
+            generator.RawRecord(record);
+            memcpy(buffer + used, record, 4);
+            used += 4;
+            break;
+        case SYNTH_SUB20:
+            generator.RawRecord(record);
+            used += SynthGenerator::Sub20Line(record, buffer + used);
+            break;
+        }
+        if (used >= out_buffer_size) {
+            ok = WriteAll(fd, buffer, used);
+            used = 0;
+        }
+    }
+    if (ok) ok = WriteAll(fd, buffer, used);
+    if (fd != 1) ok = (close(fd) == 0) && ok;
+    delete[] buffer;
+    if (!ok) {
+        cerr << "write failed\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,173 @@
+//
+// stein_hexparse.h -- table-driven parser for the "0xNN," hex-byte text
+//  produced by Brent's ASCII dump of the FSW data.  Scans a line buffer
+//  in place and writes the bytes straight into a packet array; no tokens,
+//  strings or heap allocations are made along the way.
+//
+// Each whitespace-delimited token is interpreted exactly as the former
+//  Tokenize() / substr(2, len-3) / strtol(.., 16) chain did: the first two
+//  characters ("0x") and the last character (",") of the token are
+//  dropped, and the hex digits in between are converted.
+//
+// ScanHexLine() is the checked variant used to validate packets: it also
+//  counts every token on the line and flags the first one that is not a
+//  well-formed "0xN," / "0xNN," token.
+//
+// ParseSub20Line() reads the "80 00 00 00   | ...." text logged by the
+//  SUB-20 interface (formerly read by sub20_to_binary.py).
+//
+//
+// Copyright 2013 Karl Yando
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef STEIN_HEXPARSE_H
+#define STEIN_HEXPARSE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// character classes for the lookup table
+//   0x00-0x0F : value of a hex digit
+//   HEX_SPACE : token delimiter
+//   HEX_OTHER : anything else (e.g. the "x" and "," of "0xNN,")
+enum { HEX_SPACE = 0x40, HEX_OTHER = 0x80 };
+
+struct HexTable {
+    uint8_t value[256];
+    constexpr HexTable() : value() {
+        for (int c = 0; c < 256; c++) value[c] = HEX_OTHER;
+        for (int c = '0'; c <= '9'; c++) value[c] = c - '0';
+        for (int c = 'a'; c <= 'f'; c++) value[c] = c - 'a' + 10;
+        for (int c = 'A'; c <= 'F'; c++) value[c] = c - 'A' + 10;
+        value[(unsigned char)' '] = HEX_SPACE;
+    }
+};
+static constexpr HexTable hex_table;
+
+// parse up to "max_bytes" hex-byte tokens from "line" (of length "len")
+//   into "bytes"; returns the number of tokens found.  Any bytes beyond
+//   the last token are zero-filled.
+inline size_t ParseHexLine(const char *line, size_t len, uint8_t bytes[], size_t max_bytes) {
+    const uint8_t *p   = (const uint8_t *)line;
+    const uint8_t *end = p + len;
+    const uint8_t *table = hex_table.value;
+    size_t n = 0;
+
+    while (n < max_bytes) {
+        // skip delimiters
+        while (p < end && table[*p] == HEX_SPACE) p++;
+        if (p >= end) break;
+
+        // fast path: the usual 5-character "0xNN," token
+        if (end - p >= 6 && table[p[2]] < 16 && table[p[3]] < 16
+                && table[p[4]] >= 16 && table[p[5]] == HEX_SPACE) {
+            bytes[n++] = (uint8_t)((table[p[2]] << 4) | table[p[3]]);
+            p += 6;
+            continue;
+        }
+
+        // general token: find its extent, then convert the digits between
+        //   the 2-character prefix and the 1-character suffix
+        const uint8_t *tok = p;
+        while (p < end && table[*p] != HEX_SPACE) p++;
+        uint32_t value = 0;
+        for (const uint8_t *d = tok + 2; d < p - 1 && table[*d] < 16; d++) {
+            value = (value << 4) | table[*d];
+        }
+        bytes[n++] = (uint8_t)value;
+    }
+
+    if (n < max_bytes) memset(bytes + n, 0, max_bytes - n);
+    return n;
+}
+
+
+// CHECKED PARSE (packet validation)
+struct HexLineScan {
+    size_t  n_tokens;               // tokens on the line (all of them)
+    size_t  first_bad;              // first malformed token (SIZE_MAX: none)
+};
+
+// parse as ParseHexLine() does, but count all tokens (including any past
+//   "max_bytes") and check the form of each; a trailing '\r' is ignored
+inline HexLineScan ScanHexLine(const char *line, size_t len, uint8_t bytes[], size_t max_bytes) {
+    const uint8_t *p   = (const uint8_t *)line;
+    const uint8_t *end = p + len;
+    const uint8_t *table = hex_table.value;
+    HexLineScan scan = { 0, SIZE_MAX };
+    if (end > p && end[-1] == '\r') end--;
+
+    while (true) {
+        while (p < end && table[*p] == HEX_SPACE) p++;
+        if (p >= end) break;
+
+        uint32_t value = 0;
+        bool ok;
+        // fast path: "0xNN," and a delimiter (or the end of the line)
+        if (end - p >= 5 && p[0] == '0' && (p[1] | 0x20) == 'x' && table[p[2]] < 16
+                && table[p[3]] < 16 && p[4] == ',' && (end - p == 5 || table[p[5]] == HEX_SPACE)) {
+            value = (table[p[2]] << 4) | table[p[3]];
+            ok = true;
+            p += 5;
+        } else {
+            const uint8_t *tok = p;
+            while (p < end && table[*p] != HEX_SPACE) p++;
+            size_t n = p - tok;
+            ok = (n == 4 || n == 5) && tok[0] == '0' && (tok[1] | 0x20) == 'x'
+                 && table[tok[2]] < 16 && (n == 4 || table[tok[3]] < 16) && tok[n-1] == ',';
+            for (const uint8_t *d = tok + 2; d < p - 1 && table[*d] < 16; d++) {
+                value = (value << 4) | table[*d];
+            }
+        }
+        if (!ok && scan.first_bad == SIZE_MAX) scan.first_bad = scan.n_tokens;
+        if (scan.n_tokens < max_bytes) bytes[scan.n_tokens] = (uint8_t)value;
+        scan.n_tokens++;
+    }
+
+    if (scan.n_tokens < max_bytes) memset(bytes + scan.n_tokens, 0, max_bytes - scan.n_tokens);
+    return scan;
+}
+
+
+// SUB-20 LOG TEXT
+// each line of a SUB-20 capture holds one 32-bit STEIN record as four
+//   hex bytes, followed by an ASCII gloss that is ignored:
+//
+//    80 00 00 00                                     | ....
+//
+inline bool IsSub20Blank(uint8_t c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+// parse the record at the start of "line" (of length "len") into
+//   "record"; returns 1 on success, 0 for a blank line, or -1 if the line
+//   does not begin with four 1- or 2-digit hex tokens
+inline int ParseSub20Line(const char *line, size_t len, uint8_t record[4]) {
+    const uint8_t *p   = (const uint8_t *)line;
+    const uint8_t *end = p + len;
+    const uint8_t *table = hex_table.value;
+
+    for (int k=0; k < 4; k++) {
+        while (p < end && IsSub20Blank(*p)) p++;
+        if (p >= end) return (k == 0) ? 0 : -1;
+        if (table[*p] >= 16) return -1;
+        uint32_t value = table[*p++];
+        if (p < end && table[*p] < 16) value = (value << 4) | table[*p++];
+        if (p < end && !IsSub20Blank(*p)) return -1;
+        record[k] = (uint8_t)value;
+    }
+    return 1;
+}
+
+#endif
@@ -0,0 +1,188 @@
+//
+// stein_histogram.h -- one-pass spectrum aggregation ("--histogram"): an
+//  EventSink that counts every decoded event by (EVCODE, ADD, DET_ID, DATA)
+//  instead of listing it, and writes the counts as a compact table.
+//
+// DATA is the bin: 0..127 (log bins) for FSW EVCODE 0, 0..65535 (ADC
+//  channels) for raw data, and likewise the full DATA range of the other
+//  event types.  Only occupied bins are written, one line each:
+//
+//    # window / EVCODE / ADD / DET_ID / DATA / COUNT
+//    0 0 -1 3 17 42
+//
+// "window" is the first event-list frame of the time slice the count
+//  belongs to, and each slice's table follows the previous one.  Without
+//  "--window" the whole run is one slice (window 0).  Slices are either
+//
+//    --window=@S     S seconds of packet time (FSW dumps): a slice holds
+//                    the packets whose time falls in one S-second step
+//                    from January 1, 00:00 (see PacketTime, stein_fsw.h;
+//                    "@60" slices start on the minute), and its table is
+//                    preceded by a comment line, "# packet time
+//                    1020.00000 .. 1080.00000"
+//    --window=N      N event frames (198 frames = one FSW packet): for raw
+//                    data, whose records carry no time beyond the
+//                    wrapping TIME_STAMP, this is the only measure of time
+//                    (at a steady event rate, a fixed span of it)
+//
+//  The table has the same six integer columns as the event list, so
+//  LOAD_EVENTLIST reads it as-is (see also SPECTRUM_FROM_TABLE in
+//  stein_actions.pro).
+//
+//
+// Copyright 2013 Karl Yando
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef STEIN_HISTOGRAM_H
+#define STEIN_HISTOGRAM_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "stein_output.h"
+
+class HistogramSink : public EventSink {
+public:
+    // (EVCODE 0..3) x (ADD -1..1) x (DET_ID -1..31)
+    static const int n_add = 3, n_det = 33;
+    static const int n_keys = 4 * n_add * n_det;
+    static const int32_t max_bins = 1 << 16;
+
+    // "window" = frames per time slice, or "window_ticks" = packet time
+    //   per slice (packet_time_ticks per second; needs Packet()); neither:
+    //   the whole run is one slice
+    explicit HistogramSink(int fd = 1, uint64_t window = 0, uint64_t window_ticks = 0)
+        : writer(fd), window(window), window_ticks(window_ticks), slice(0), first_frame(0),
+          n_counted(0), n_outside(0) {}
+
+    void Packet(const PacketInfo &info) {
+        if (window_ticks && info.time / window_ticks != slice) {
+            WriteTable();
+            slice = info.time / window_ticks;
+        }
+    }
+
+    void Event(uint64_t frame, int32_t evcode, int32_t add, int32_t det_id,
+               int32_t /*time_stamp*/, int32_t data) {
+        if (window && frame / window != slice) {
+            WriteTable();
+            slice = frame / window;
+        }
+        if ((uint32_t)evcode > 3 || add < -1 || add > 1 || det_id < -1 || det_id > 31
+                || data < 0 || data >= max_bins) {
+            n_outside++;                // (invalid fields; not a spectrum bin)
+            return;
+        }
+        std::vector<uint64_t> &bins = counts[(evcode*n_add + add + 1)*n_det + det_id + 1];
+        if ((size_t)data >= bins.size()) Grow(bins, data);
+        bins[data]++;
+        if (n_counted++ == 0) first_frame = window_ticks ? frame : slice * window;
+    }
+
+    void Header() {
+        writer.Write("# window / EVCODE / ADD / DET_ID / DATA / COUNT\n");
+    }
+    void Comment(const char *text) { writer.Write(text); }
+    void Flush() { writer.Flush(); }
+    bool Failed() const { return writer.Failed(); }
+
+    // add the counts of "other" (a whole run, no --window), e.g. one
+    //   file's spectra into those of a batch
+    void Merge(const HistogramSink &other) {
+        for (int k=0; k < n_keys; k++) {
+            const std::vector<uint64_t> &from = other.counts[k];
+            std::vector<uint64_t> &bins = counts[k];
+            for (size_t b=0; b < from.size(); b++) {
+                if (from[b] == 0) continue;
+                if (b >= bins.size()) Grow(bins, (int32_t)b);
+                bins[b] += from[b];
+            }
+        }
+        n_counted += other.n_counted;
+        n_outside += other.n_outside;
+    }
+
+    // the counts of (EVCODE, ADD, DET_ID) by DATA bin, so far (a whole run,
+    //   no --window); bins past the end of the vector hold nothing
+    const std::vector<uint64_t> &Bins(int32_t evcode, int32_t add, int32_t det_id) const {
+        return counts[(evcode*n_add + add + 1)*n_det + det_id + 1];
+    }
+
+    void Finish() {
+        WriteTable();
+        if (n_outside) {                // (stderr, so the table stays plain columns)
+            fprintf(stderr, "# histogram: %llu events outside any bin\n",
+                    (unsigned long long)n_outside);
+        }
+        writer.Flush();
+    }
+
+private:
+    EventWriter             writer;
+    uint64_t                window;
+    uint64_t                window_ticks;
+    uint64_t                slice;          // (current slice number)
+    uint64_t                first_frame;    // (of the current slice)
+    uint64_t                n_counted;      // events in the current slice
+    uint64_t                n_outside;
+    std::vector<uint64_t>   counts[n_keys]; // (grown as values are seen)
+
+    // room for bin "value": at least 128 bins, doubled (256, 512, ...) until
+    //   "value" fits
+    static void Grow(std::vector<uint64_t> &bins, int32_t value) {
+        size_t n = bins.size() ? bins.size() : 128;
+        while (n <= (size_t)value) n *= 2;
+        bins.resize(n, 0);
+    }
+
+    // occupied bins of the current slice, then start the next one empty
+    void WriteTable() {
+        if (n_counted == 0) return;
+        if (window_ticks) {
+            char line [64] = "# packet time ";
+            char *p = FormatPacketTime(line + strlen(line), slice * window_ticks);
+            memcpy(p, " .. ", 4);
+            p = FormatPacketTime(p + 4, (slice + 1) * window_ticks);
+            *p++ = '\n';
+            writer.Write(line, p - line);
+        }
+        for (int k=0; k < n_keys; k++) {
+            std::vector<uint64_t> &bins = counts[k];
+            int32_t evcode = k / (n_add * n_det);
+            int32_t add = (k / n_det) % n_add - 1;
+            int32_t det_id = k % n_det - 1;
+            for (size_t b=0; b < bins.size(); b++) {
+                if (bins[b] == 0) continue;
+                char line [max_event_line];
+                char *p = FormatUnsigned(line, first_frame);   *p++ = ' ';
+                p = FormatSigned(p, evcode);                    *p++ = ' ';
+                p = FormatSigned(p, add);                       *p++ = ' ';
+                p = FormatSigned(p, det_id);                    *p++ = ' ';
+                p = FormatUnsigned(p, b);                       *p++ = ' ';
+                p = FormatUnsigned(p, bins[b]);                 *p++ = '\n';
+                writer.Write(line, p - line);
+                bins[b] = 0;
+            }
+        }
+        n_counted = 0;
+    }
+
+    HistogramSink(const HistogramSink &);
+    HistogramSink &operator=(const HistogramSink &);
+};
+
+#endif
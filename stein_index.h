@@ -0,0 +1,245 @@
+//
+// stein_index.h -- sidecar packet index for FSW dumps ("<dump>.idx"), for
+//  random access into a dump without re-parsing it: fsw_steinunpack
+//  writes it with "--build-index", and "--from / --to" use it to seek
+//  straight to the packets of a time or packet-number range.
+//
+// FILE LAYOUT (all integers little-endian):
+//
+//    PacketIndexHeader                    32 bytes
+//    PacketIndexEntry [n_packets]         32 bytes each, in file order
+//
+// Entry "i" describes packet "i" (the i-th non-blank line of the dump,
+//  whose events are frames 198*i .. 198*i + 197 of the event list): the
+//  byte offset of its line, its line number (from 0, blank lines
+//  included), its packet time (PacketTime of its month / day / hour /
+//  minute / second / fraction timestamp, stein_fsw.h), and how many of its events carry each EVCODE.  A packet that
+//  fails validation has no events (counts 0), and the time of the last
+//  valid packet before it (0 if none), so packet times stay in order.
+//  The header records the size and modification time of the dump, so an
+//  index left over from an older version of the file is not trusted.
+//
+//
+// Copyright 2013 Karl Yando
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef STEIN_INDEX_H
+#define STEIN_INDEX_H
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "stein_fsw.h"
+#include "stein_output.h"
+
+static const char     index_magic[8] = {'S','T','E','I','N','I','D','X'};
+static const uint32_t index_version = 4;
+
+struct PacketIndexHeader {
+    char        magic[8];       // "STEINIDX"
+    uint32_t    version;        // index_version
+    uint32_t    entry_size;     // sizeof(PacketIndexEntry)
+    uint64_t    source_size;    // size of the dump when indexed
+    int64_t     source_mtime;   // (seconds) modification time of the dump
+};
+
+struct PacketIndexEntry {
+    uint64_t    offset;         // byte offset of the packet's line
+    uint64_t    line;           // line number of the packet (from 0)
+    uint64_t    time;           // packet time (see PacketTime)
+    uint16_t    counts[4];      // events per EVCODE 0..3
+};
+
+// the sidecar index of "dump"
+inline std::string IndexPath(const char *dump) { return std::string(dump) + ".idx"; }
+
+
+// collects entries during an index-build pass, then writes the sidecar
+class PacketIndexWriter {
+public:
+    PacketIndexWriter() : entries(NULL), n(0), capacity(0) {}
+    ~PacketIndexWriter() { free(entries); }
+
+    void Add(const PacketIndexEntry &entry) {
+        if (n == capacity) {
+            capacity = capacity ? 2 * capacity : 4096;
+            entries = (PacketIndexEntry *)realloc(entries, capacity * sizeof(PacketIndexEntry));
+        }
+        entries[n++] = entry;
+    }
+
+    uint64_t NPackets() const { return n; }
+
+    // write the index of "dump" (as it is now) to "path"; returns false
+    //   on error
+    bool Write(const char *path, const char *dump) const {
+        struct stat results;
+        if (stat(dump, &results) != 0) return false;
+        PacketIndexHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, index_magic, sizeof(index_magic));
+        header.version = index_version;
+        header.entry_size = sizeof(PacketIndexEntry);
+        header.source_size = results.st_size;
+        header.source_mtime = results.st_mtime;
+
+        // (write to a temporary name, so a reader never sees half an index)
+        std::string tmp = std::string(path) + ".tmp";
+        int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) return false;
+        bool ok = WriteAll(fd, &header, sizeof(header))
+               && WriteAll(fd, entries, n * sizeof(PacketIndexEntry));
+        ok = (close(fd) == 0) && ok;
+        if (ok) ok = (rename(tmp.c_str(), path) == 0);
+        if (!ok) unlink(tmp.c_str());
+        return ok;
+    }
+
+private:
+    PacketIndexEntry    *entries;
+    uint64_t            n, capacity;
+
+    PacketIndexWriter(const PacketIndexWriter &);
+    PacketIndexWriter &operator=(const PacketIndexWriter &);
+};
+
+
+// memory-mapped index; entries are used in place
+class PacketIndex {
+public:
+    PacketIndex() : map(NULL), map_len(0), entries(NULL), n(0), increasing(true) {}
+    ~PacketIndex() { Close(); }
+
+    // map the index at "path", if it is valid and up to date for "dump"
+    bool Open(const char *path, const char *dump) {
+        Close();
+        struct stat source, results;
+        if (stat(dump, &source) != 0) return false;
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) return false;
+        if (fstat(fd, &results) == 0 && results.st_size >= (off_t)sizeof(PacketIndexHeader)) {
+            map_len = results.st_size;
+            void *p = mmap(NULL, map_len, PROT_READ, MAP_SHARED, fd, 0);
+            if (p != MAP_FAILED) map = (const uint8_t *)p;
+        }
+        close(fd);
+
+        const PacketIndexHeader *header = (const PacketIndexHeader *)map;
+        if (!map || memcmp(header->magic, index_magic, sizeof(index_magic)) != 0
+                 || header->version != index_version
+                 || header->entry_size != sizeof(PacketIndexEntry)
+                 || header->source_size != (uint64_t)source.st_size
+                 || header->source_mtime != (int64_t)source.st_mtime
+                 || (map_len - sizeof(PacketIndexHeader)) % sizeof(PacketIndexEntry) != 0) {
+            Close();
+            return false;
+        }
+        entries = (const PacketIndexEntry *)(map + sizeof(PacketIndexHeader));
+        n = (map_len - sizeof(PacketIndexHeader)) / sizeof(PacketIndexEntry);
+        increasing = true;
+        for (uint64_t i=1; i < n && increasing; i++) {
+            increasing = (entries[i-1].time <= entries[i].time);
+        }
+        return true;
+    }
+
+    void Close() {
+        if (map) munmap((void *)map, map_len);
+        map = NULL; map_len = 0; entries = NULL; n = 0;
+    }
+
+    uint64_t NPackets() const { return n; }
+    const PacketIndexEntry &Entry(uint64_t i) const { return entries[i]; }
+
+    // first packet at or after packet time "t" (NPackets() if none): a
+    //   binary search when packet times increase through the dump (as in
+    //   flight data), else the first such packet in file order
+    uint64_t FindTime(uint64_t t) const {
+        if (!increasing) {
+            uint64_t i = 0;
+            while (i < n && entries[i].time < t) i++;
+            return i;
+        }
+        uint64_t lo = 0, hi = n;
+        while (lo < hi) {
+            uint64_t mid = lo + (hi - lo) / 2;
+            if (entries[mid].time < t) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo;
+    }
+
+private:
+    const uint8_t           *map;
+    uint64_t                map_len;
+    const PacketIndexEntry  *entries;
+    uint64_t                n;
+    bool                    increasing;     // (packet times never decrease)
+
+    PacketIndex(const PacketIndex &);
+    PacketIndex &operator=(const PacketIndex &);
+};
+
+
+// one end of a "--from / --to" range: a packet number ("N"), or a packet
+//   time, in seconds since January 1 ("@T") or as the timestamp's own
+//   fields ("@MM-DDThh:mm:ss", seconds may have a fraction)
+struct PacketBound {
+    bool        is_time;
+    uint64_t    value;          // (packet number, or packet time units)
+};
+
+// parse "N", "@T" or "@MM-DDThh:mm:ss" into "bound"; returns false if
+//   malformed
+inline bool ParsePacketBound(const char *text, PacketBound &bound) {
+    char *end;
+    bound.is_time = (*text == '@');
+    if (bound.is_time && strchr(text, '-')) {
+        unsigned int month, day, hour, minute;
+        double second;
+        int n = 0;
+        if (sscanf(text + 1, "%2u-%2uT%2u:%2u:%lf%n", &month, &day, &hour, &minute,
+                   &second, &n) != 5 || text[1 + n] != '\0' || month < 1 || month > 12
+                || day < 1 || day > 31 || hour > 23 || minute > 59
+                || !(second >= 0 && second < 60)) return false;
+        uint8_t timestamp [timestamp_size] = { (uint8_t)month, (uint8_t)day,
+                                               (uint8_t)hour, (uint8_t)minute, 0, 0 };
+        bound.value = PacketTime(timestamp) + (uint64_t)(second * packet_time_ticks + 0.5);
+    } else if (bound.is_time) {
+        double t = strtod(text + 1, &end);
+        if (end == text + 1 || *end != '\0' || t < 0) return false;
+        bound.value = (uint64_t)(t * packet_time_ticks + 0.5);
+    } else {
+        if (*text < '0' || *text > '9') return false;
+        bound.value = strtoull(text, &end, 10);
+        if (*end != '\0') return false;
+    }
+    return true;
+}
+
+// the packet a bound refers to (first packet at or after a time)
+inline uint64_t ResolvePacketBound(const PacketIndex &index, const PacketBound &bound) {
+    if (bound.is_time) return index.FindTime(bound.value);
+    return (bound.value < index.NPackets()) ? bound.value : index.NPackets();
+}
+
+#endif
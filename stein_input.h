@@ -0,0 +1,382 @@
+//
+// stein_input.h -- zero-copy input for the STEIN unpacking tools.  Regular
+//  files are memory-mapped and handed to the decoder a window at a time,
+//  straight from the mapped pages; pages behind the window are released
+//  as the decoder moves on, so resident memory stays small however large
+//  the file is.  Anything that cannot be mapped (pipes, FIFOs, terminals)
+//  falls back to chunked read() calls into a fixed-size buffer.  The path
+//  "-" is standard input.
+//
+// With "follow" set (--follow), the input is read as it grows: a capture
+//  file still being written, or a pipe from the acquisition software.
+//  Every Fill() hands over whatever has arrived so far (a partial record
+//  at the end stays in the buffer until the rest of it comes in), and
+//  Idle() turns true once everything available has been read; the caller
+//  then flushes its output and calls Wait().  A followed file never ends
+//  by itself; a pipe ends when its writer closes it, and either ends on
+//  SIGINT / SIGTERM once CatchStopSignals() has been called, so the run
+//  still completes its output.
+//
+// Compressed files (gzip, zstd, xz or bzip2, recognized by the name's
+//  suffix, or else by a complete header -- magic bytes alone can be a raw
+//  record) are decompressed as they are read: the matching "-dc" program
+//  runs as a child process -- on a core of its own -- and its output comes
+//  in through a pipe, which bounds how far it can run ahead of the
+//  decoder.  Nothing is written to disk.  Such an input streams like a
+//  pipe (no mapping, no SetRange()); Failed() reports a decompressor that
+//  did not finish cleanly (corrupt or truncated data, or no program).
+//  Compressed standard input is not recognized; pipe it through the
+//  decompressor instead.  Open(path, follow, false) reads a file as it is.
+//
+// Typical use:
+//
+//    InputSource input;
+//    if (!input.Open(fileName)) ...
+//    while (input.Fill()) {
+//        // decode whole records from input.Data() / input.Available(),
+//        //   then tell the source how much was used
+//        input.Consume(n_used);
+//    }
+//
+// Sizes and offsets are 64-bit throughout.
+//
+//
+// Copyright 2013 Karl Yando
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef STEIN_INPUT_H
+#define STEIN_INPUT_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// set by SIGINT / SIGTERM (after CatchStopSignals()): stop following
+static volatile sig_atomic_t input_stop = 0;
+
+inline void StopSignalHandler(int) { input_stop = 1; }
+
+// end a followed input cleanly on SIGINT / SIGTERM (blocking reads and
+//   waits are interrupted, not restarted)
+inline void CatchStopSignals() {
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = StopSignalHandler;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+}
+
+// a compressed format, and the program that decompresses it to stdout
+struct Decompressor {
+    const char  *suffix;                // (file name ending)
+    const char  *program;               // (run as "program -dc")
+};
+
+static const Decompressor decompressors[] = {
+    { ".gz", "gzip" },
+    { ".zst", "zstd" },
+    { ".xz", "xz" },
+    { ".bz2", "bzip2" },
+};
+static const size_t n_decompressors = sizeof(decompressors) / sizeof(decompressors[0]);
+
+// true if "head" (the first "n" bytes of a file) is a complete, valid
+//   header of compressed format "k" -- not just its magic bytes, which a
+//   raw capture's first record can hold by chance (e.g. 1f 8b xx xx, an
+//   EVCODE 0 event of DET_ID 31)
+inline bool CompressedHeader(size_t k, const uint8_t *head, size_t n) {
+    switch (k) {
+    case 0:     // gzip: 1f 8b, deflate, no reserved flags; XFL 0/2/4; OS 0..13 or 255
+        return n >= 10 && head[0] == 0x1f && head[1] == 0x8b && head[2] == 8
+            && (head[3] & 0xe0) == 0 && (head[8] == 0 || head[8] == 2 || head[8] == 4)
+            && (head[9] <= 13 || head[9] == 255);
+    case 1:     // zstd: frame magic, then a frame header without its reserved bit
+        return n >= 5 && memcmp(head, "\x28\xb5\x2f\xfd", 4) == 0 && (head[4] & 0x08) == 0;
+    case 2:     // xz: stream magic, then stream flags (00, check type 0/1/4/10)
+        return n >= 8 && memcmp(head, "\xfd" "7zXZ\x00", 6) == 0 && head[6] == 0
+            && (head[7] == 0 || head[7] == 1 || head[7] == 4 || head[7] == 10);
+    case 3:     // bzip2: "BZh1".."BZh9", then a block (pi) or end-of-stream (sqrt pi) magic
+        return n >= 10 && memcmp(head, "BZh", 3) == 0 && head[3] >= '1' && head[3] <= '9'
+            && (memcmp(head + 4, "\x31\x41\x59\x26\x53\x59", 6) == 0
+                || memcmp(head + 4, "\x17\x72\x45\x38\x50\x90", 6) == 0);
+    }
+    return false;
+}
+
+// the decompressor for (regular) file "path", open on "fd", or NULL if it
+//   is not compressed: by its name's suffix (".gz", ".zst", ".xz", ".bz2")
+//   if it has one, otherwise by its header
+inline const Decompressor *DetectCompression(int fd, const char *path) {
+    size_t len = strlen(path);
+    for (size_t k=0; k < n_decompressors; k++) {
+        size_t n = strlen(decompressors[k].suffix);
+        if (len > n && strcmp(path + len - n, decompressors[k].suffix) == 0) {
+            return &decompressors[k];
+        }
+    }
+    uint8_t head [10];
+    ssize_t n = pread(fd, head, sizeof(head), 0);
+    for (size_t k=0; k < n_decompressors; k++) {
+        if (n > 0 && CompressedHeader(k, head, (size_t)n)) return &decompressors[k];
+    }
+    return NULL;
+}
+
+// the decompressor for file "path", or NULL (not compressed, or unreadable)
+inline const Decompressor *DetectCompression(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat results;
+    const Decompressor *d = NULL;
+    if (fstat(fd, &results) == 0 && S_ISREG(results.st_mode)) d = DetectCompression(fd, path);
+    close(fd);
+    return d;
+}
+
+class InputSource {
+public:
+    // bytes exposed per Fill() when mapped, and buffer size when streaming
+    static const size_t window_size = 16UL << 20;
+    // how often a followed file is checked for new data
+    static const int follow_interval_ms = 100;
+    // pipe capacity asked for when decompressing
+    static const int decompress_pipe_size = 1 << 20;
+
+    InputSource() : fd(-1), map(NULL), map_len(0), limit(0), buffer(NULL), begin(0), end(0),
+                    released(0), offset(0), eof(false), follow(false),
+                    regular(false), idle(false), compressed(false), child(-1), failed(false) {}
+    ~InputSource() { Close(); }
+
+    // open "path" ("-": standard input) for reading, following it as it
+    //   grows if "follow", and decompressing it if it is compressed unless
+    //   not "decompress"; returns false if it cannot be opened
+    bool Open(const char *path, bool follow = false, bool decompress = true) {
+        Close();
+        fd = (strcmp(path, "-") == 0) ? fcntl(0, F_DUPFD_CLOEXEC, 0)
+                                      : open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) return false;
+        this->follow = follow;
+
+        struct stat results;
+        regular = (fstat(fd, &results) == 0 && S_ISREG(results.st_mode));
+        if (regular && decompress) {
+            if (const Decompressor *d = DetectCompression(fd, path)) return Decompress(d);
+        }
+        if (regular && results.st_size > 0 && !follow) {
+            map_len = (uint64_t)results.st_size;
+            void *p = mmap(NULL, map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                map = (const uint8_t *)p;
+                limit = map_len;
+                madvise((void *)map, map_len, MADV_SEQUENTIAL);
+                return true;
+            }
+            map_len = 0;            // (fall through to read())
+        }
+        buffer = new uint8_t [window_size];
+        return true;
+    }
+
+    void Close() {
+        if (map) munmap((void *)map, map_len);
+        if (fd >= 0) close(fd);
+        Reap();
+        delete[] buffer;
+        fd = -1; map = NULL; map_len = limit = 0; buffer = NULL;
+        begin = end = released = offset = 0;
+        eof = follow = regular = idle = compressed = failed = false;
+    }
+
+    bool IsMapped() const { return map != NULL; }
+    // true if a compressed file is being decompressed
+    bool IsCompressed() const { return compressed; }
+    // true if the input was cut short (the decompressor failed)
+    bool Failed() const { return failed; }
+
+    // (follow mode) true when everything available so far has been read
+    bool Idle() const { return idle; }
+    // true if the input ended on a stop signal rather than at its end
+    bool Stopped() const { return input_stop != 0; }
+
+    // (follow mode) block until more input may be available, or a stop
+    //   signal arrives
+    void Wait() {
+        if (input_stop) return;
+        if (regular) {
+            poll(NULL, 0, follow_interval_ms);      // (files are never "ready")
+        } else {
+            struct pollfd p = { fd, POLLIN, 0 };
+            poll(&p, 1, -1);
+        }
+    }
+
+    // total input size, if known in advance (mapped files only)
+    uint64_t Size() const { return map_len; }
+
+    // (mapped files only) read just bytes [from, to) of the file, e.g. the
+    //   packets picked out by a sidecar index; returns false if the input
+    //   cannot seek
+    bool SetRange(uint64_t from, uint64_t to) {
+        if (!map || from > to || to > map_len) return false;
+        begin = end = offset = from;
+        released = from - (from % (uint64_t)sysconf(_SC_PAGESIZE));
+        limit = to;
+        return true;
+    }
+
+    // unconsumed bytes, and the absolute stream offset of Data()
+    const uint8_t *Data() const { return (map ? map : buffer) + begin; }
+    uint64_t Available() const { return end - begin; }
+    uint64_t Offset() const { return offset; }
+
+    void Consume(uint64_t n) { begin += n; offset += n; }
+
+    // make more bytes available after any unconsumed ones; returns false
+    //   once the input is exhausted and nothing new could be added
+    bool Fill() {
+        if (map) {
+            // give back the pages the decoder has finished with
+            uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+            uint64_t done = begin - (begin % page);
+            if (done > released) {
+                madvise((void *)(map + released), done - released, MADV_DONTNEED);
+                released = done;
+            }
+            if (end >= limit) return false;
+            end = (limit - end > window_size) ? end + window_size : limit;
+            return true;
+        }
+
+        // streaming: move the unconsumed tail (e.g. a partial record) to
+        //   the front, then read more
+        if (eof) return false;
+        uint64_t keep = end - begin;
+        if (keep && begin) memmove(buffer, buffer + begin, keep);
+        begin = 0;
+        end = keep;
+        if (follow) return FollowRead(keep);
+        while (end < window_size) {
+            ssize_t got = read(fd, buffer + end, window_size - end);
+            if (got > 0) { end += got; continue; }
+            if (got < 0 && errno == EINTR) continue;
+            eof = true;             // (EOF or read error)
+            if (got < 0) failed = true;
+            Reap();
+            break;
+        }
+        return end > keep;
+    }
+
+private:
+    // read the file open on "fd" through "d" (a child process feeding a
+    //   pipe); the file is the child's standard input
+    bool Decompress(const Decompressor *d) {
+        int ends [2];
+        if (pipe2(ends, O_CLOEXEC) != 0) return false;     // (kept from other children)
+        child = fork();
+        if (child == 0) {
+            dup2(fd, 0);
+            dup2(ends[1], 1);
+            close(ends[0]);
+            close(ends[1]);
+            close(fd);
+            execlp(d->program, d->program, "-dc", (char *)NULL);
+            _exit(127);                         // (no such program)
+        }
+        close(ends[1]);
+        close(fd);
+        fd = ends[0];
+        if (child < 0) {
+            child = -1;
+            close(fd);
+            fd = -1;
+            return false;
+        }
+#ifdef F_SETPIPE_SZ
+        fcntl(fd, F_SETPIPE_SZ, decompress_pipe_size);     // (fewer, larger reads)
+#endif
+        regular = false;
+        compressed = true;
+        buffer = new uint8_t [window_size];
+        return true;
+    }
+
+    // wait for the decompressor; it failed unless it exited with status 0
+    //   (one stopped early by Close() counts as clean)
+    void Reap() {
+        if (child <= 0) return;
+        bool early = !eof;
+        if (early) kill(child, SIGTERM);
+        int status;
+        while (waitpid(child, &status, 0) < 0 && errno == EINTR) {}
+        if (!early && !(WIFEXITED(status) && WEXITSTATUS(status) == 0)) failed = true;
+        child = -1;
+    }
+
+    // (follow mode) read whatever is there now, without waiting for the
+    //   buffer to fill; returns false only at the very end of the input
+    bool FollowRead(uint64_t keep) {
+        idle = false;
+        while (end < window_size) {
+            if (input_stop) { eof = true; break; }
+            if (!regular) {                     // (don't block on a quiet pipe)
+                struct pollfd p = { fd, POLLIN, 0 };
+                if (poll(&p, 1, 0) == 0) { idle = true; break; }
+            }
+            ssize_t got = read(fd, buffer + end, window_size - end);
+            if (got > 0) {
+                end += got;
+                if (!regular) break;            // (hand over what came in)
+                continue;
+            }
+            if (got < 0 && errno == EINTR) continue;
+            if (got == 0 && regular) { idle = true; break; }   // (for now)
+            eof = true;             // (pipe closed, or read error)
+            if (got < 0) failed = true;
+            Reap();
+            break;
+        }
+        return !eof || end > keep;
+    }
+
+    int             fd;
+    const uint8_t   *map;           // mapped file (or NULL)
+    uint64_t        map_len;
+    uint64_t        limit;          // end of the mapped bytes to read
+    uint8_t         *buffer;        // read() buffer (when not mapped)
+    uint64_t        begin, end;     // unconsumed window within map/buffer
+    uint64_t        released;       // mapped bytes already given back
+    uint64_t        offset;         // absolute offset of Data()
+    bool            eof;
+    bool            follow;         // read as the input grows
+    bool            regular;        // (a regular file)
+    bool            idle;           // (follow) nothing more to read yet
+    bool            compressed;     // (read through a decompressor)
+    pid_t           child;          // decompressor process (or -1)
+    bool            failed;         // (decompressor error)
+
+    InputSource(const InputSource &);
+    InputSource &operator=(const InputSource &);
+};
+
+#endif
@@ -0,0 +1,385 @@
+//
+// stein_kernel.h -- batch kernel that unpacks a whole 495-byte STEIN frame
+//  from an FSW packet into its 198 events and decodes all five fields of
+//  every event at once.
+//
+// The frame is a little-endian stream of 20-bit event reports (every 5
+//  bytes hold 2 events).  The vector kernels gather 4 (SSE4.1) or 8 (AVX2)
+//  reports per step with byte shuffles, then decode EVCODE / ADD / DET_ID /
+//  TIME_STAMP / DATA for every lane with compares and masked selects in
+//  place of the per-event switch.  Field positions in every kernel come
+//  from the layout descriptors in stein_layout.h; the scalar kernel is the
+//  table-driven decoder generated there, and is the portable fallback.
+//  ExtractEvents + Parse_EventReport, as originally written for
+//  fsw_steinunpack, are kept as the reference every kernel must match bit
+//  for bit; stein_bench checks this over all 2^20 possible reports.
+//
+// UnpackFrame() points at the fastest kernel the CPU supports, chosen at
+//  start-up; the environment variable STEIN_KERNEL=scalar|sse4|avx2 can
+//  force a particular one.
+//
+//
+// Copyright 2013 Karl Yando
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef STEIN_KERNEL_H
+#define STEIN_KERNEL_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stein_layout.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define STEIN_KERNEL_X86 1
+#include <immintrin.h>
+#endif
+
+static const uint16_t frame_bytes  = 495;      // size (BYTES) of a STEIN frame
+static const uint16_t frame_events = 198;      // STEIN events per frame
+
+// decoded events of one frame, one array per field
+struct EventBatch {
+    int16_t evcode      [frame_events];
+    int16_t add         [frame_events];
+    int16_t det_id      [frame_events];
+    int16_t time_stamp  [frame_events];
+    int32_t data        [frame_events];
+};
+
+
+// ---------------------------------------------------------------------
+// REFERENCE (the original per-event decode)
+// ---------------------------------------------------------------------
+
+// function to extract events from the 495-byte STEIN data block
+inline void ExtractEvents(const uint8_t stein_frame[], uint32_t event_log[]) {
+    // 495-byte block, comprising 198 events of 20 bits each
+    // So.. every 5 bytes gives us 2 complete STEIN events
+    uint16_t increment = 5;             // (bytes)
+    uint16_t n_events = 198;            // (events)
+    uint32_t working_bytes [increment];  // 5-byte chunk to work with 
+
+    // storage arrays (16-bit should be ok)
+    uint32_t event1, event2;            // for processing
+    
+    for (uint16_t i=0; i <= ((n_events/2) -1); i++) {
+        // populate "working_bytes"
+        for (uint16_t j=0; j < increment; j++) {
+            working_bytes[j] = stein_frame[j + i*increment];
+        }
+        // split, bitshift, and re-construct event values
+        event1 = ((working_bytes[2] & 15L) << 16) + (working_bytes[1] << 8) + (working_bytes[0]);
+        event2 = (working_bytes[4] << 12) + (working_bytes[3] << 4) + (working_bytes[2] >> 4);
+        event_log[2*i] = event1;        // place in event_log
+        event_log[2*i + 1] = event2;    //      """
+    }
+    // no return value needed, as we're modifying event_log itself (we hope!)
+}
+
+// invalid fields met by Parse_EventReport, counted rather than printed as
+//   "Error!" lines into the event list (a 20-bit report cannot produce
+//   them; the reference decode runs single-threaded, in stein_bench)
+struct ReferenceErrors {
+    uint64_t    evcode;
+    uint64_t    add;
+};
+static ReferenceErrors reference_errors = { 0, 0 };
+
+inline void Parse_EventReport(uint32_t stein_event, int16_t &evcode, int16_t &add, int16_t &det_id, int16_t &time_stamp, int32_t &event_data) {
+   evcode = stein_event >> 18;
+   switch (evcode) {
+    case 0:     // (i.e., is a data packet)
+        // no ADD bit (0 bits; all bits dropped)
+        add=-1;
+        // DET_ID (5 bits)
+        det_id = (stein_event >> (20 - (2+5))) & 31;
+        // TIMESTAMP (6 bits; 2 LSB dropped)
+        time_stamp = (stein_event >> (20 - (2+5+6))) & 63;
+        // EVENT_DATA (7 bits; 9 bits dropped via log-binning)
+        event_data = (stein_event >> (20 - (2+5+6+7))) & 127;
+        break;
+    case 1:     // (i.e., Sweep checksum/# of triggers per second)
+        // no ADD bit (0 bits; all bits dropped)
+        add = -1;
+        // no DET_ID bits (0 bits; all bits dropped)
+        det_id = -1;
+        // TIMESTAMP (6 bits; 2 MSB dropped)
+        time_stamp = (stein_event >> (20 - (2+6))) & 63;
+        // DATA (12 bits; 4 lower bits dropped)
+        event_data = (stein_event >> (20 - (2+6+12))) & 4095;
+       break;
+    case 2:     // (i.e., Sweep checksum/# of events per second)
+        // no ADD bit (0 bits; all bits dropped)
+        add = -1;
+        // no DET_ID bits (0 bits; all bits dropped)
+        det_id = -1;
+        // TIMESTAMP (6 bits; 2 MSB dropped)
+        time_stamp = (stein_event >> (20 - (2+6))) & 63;
+        // DATA (12 bits; 4 lower bits dropped)
+        event_data = (stein_event >> (20 - (2+6+12))) & 4095;
+        break;
+    case 3: 
+        // ADD bit (1 bit; no bits dropped)
+        add =(stein_event >> (20 - (2+1))) & 1;
+        if (add == 0) { // EVCODE3 TYPE 1 (noise event)
+            // DET_ID bits (1 bit; 4 MSB dropped)
+            det_id = (stein_event >> (20 - (2+1+1))) & 1;
+            // TIMESTAMP (0 bits; all bits dropped)
+            time_stamp = -1;
+            // DATA (16 bits; no bits dropped)
+            event_data = stein_event & 65535L;
+        } else if (add == 1) {// EVCODE3 TYPE 2 (status event)
+            // DET_ID bits (0 bits; all bits dropped)
+            det_id = -1;
+            // TIMESTAMP (8 bits; no bits dropped)
+            time_stamp = (stein_event >> (20 - (2+1+8))) & 255;
+            // DATA (9 bits; 7 MSB dropped)
+            event_data = stein_event & 511;
+        } else {
+            reference_errors.add++;     // (was "Error! (INVALID ADD!)")
+        }
+        break;
+    default:
+        reference_errors.evcode++;      // (was "Error! (INVALID EVCODE!)")
+        add = -1;
+        det_id = -1;
+        time_stamp = -1;
+        event_data = -1;
+      break; 
+   }
+
+}
+
+
+inline void UnpackFrame_Reference(const uint8_t frame[], EventBatch &out) {
+    uint32_t event_log [frame_events];
+    ExtractEvents(frame, event_log);
+    for (uint16_t i=0; i < frame_events; i++) {
+        Parse_EventReport(event_log[i], out.evcode[i], out.add[i], out.det_id[i],
+                out.time_stamp[i], out.data[i]);
+    }
+}
+
+
+// ---------------------------------------------------------------------
+// SCALAR (generated from the stein_layout.h descriptors)
+// ---------------------------------------------------------------------
+
+// scalar decode of events "first" .. 197 (the part of a frame too close to
+//   its end for a full-width vector load)
+inline void UnpackTail(const uint8_t frame[], EventBatch &out, uint16_t first) {
+    for (uint16_t i=first; i < frame_events; i++) {
+        const uint8_t *b = frame + (5*i)/2;
+        uint32_t event = (i & 1) ? ((b[0] >> 4) | (b[1] << 4) | (b[2] << 12))
+                                 : (b[0] | (b[1] << 8) | ((b[2] & 15) << 16));
+        DecodeFswEvent(event, out.evcode[i], out.add[i], out.det_id[i],
+                out.time_stamp[i], out.data[i]);
+    }
+}
+
+inline void UnpackFrame_Scalar(const uint8_t frame[], EventBatch &out) {
+    UnpackTail(frame, out, 0);
+}
+
+
+#ifdef STEIN_KERNEL_X86
+// The vector kernels decode every lane with all of the shifts and masks
+//   below and select per lane; they rely on EVCODE 1 and 2 sharing a
+//   layout and on DATA sitting in the low bits of every report.
+static_assert(FswEvcode1::time_stamp::shift == FswEvcode2::time_stamp::shift &&
+              FswEvcode1::data::mask == FswEvcode2::data::mask,
+              "vector kernels assume EVCODE 1 and 2 share a layout");
+static_assert(FswEvcode0::data::shift == 0 && FswEvcode1::data::shift == 0 &&
+              FswEvcode3Add0::data::shift == 0 && FswEvcode3Add1::data::shift == 0,
+              "vector kernels assume DATA is in the low bits");
+
+// ---------------------------------------------------------------------
+// SSE4.1: 4 events (10 bytes) per step
+// ---------------------------------------------------------------------
+
+// decode four 20-bit reports (one per 32-bit lane) into their fields
+__attribute__((target("sse4.1")))
+inline void DecodeLanes_SSE4(__m128i e, __m128i &evcode, __m128i &add, __m128i &det_id,
+                             __m128i &time_stamp, __m128i &data) {
+    const __m128i zero   = _mm_setzero_si128();
+    const __m128i one    = _mm_set1_epi32(1);
+    const __m128i minus1 = _mm_set1_epi32(-1);
+
+    evcode = _mm_srli_epi32(e, FswEvCode::shift);
+    __m128i is0  = _mm_cmpeq_epi32(evcode, zero);
+    __m128i is3  = _mm_cmpeq_epi32(evcode, _mm_set1_epi32(3));
+    __m128i is12 = _mm_andnot_si128(_mm_or_si128(is0, is3), minus1);
+    __m128i addb = _mm_and_si128(_mm_srli_epi32(e, FswAdd::shift), one);
+    __m128i add1 = _mm_and_si128(is3, _mm_cmpeq_epi32(addb, one));
+    __m128i add0 = _mm_andnot_si128(add1, is3);
+
+    // ADD: only EVCODE 3 carries the bit
+    add = _mm_blendv_epi8(minus1, addb, is3);
+    // DET_ID: 5 bits for EVCODE 0, 1 bit for EVCODE 3 / ADD 0
+    det_id = _mm_blendv_epi8(minus1, _mm_and_si128(_mm_srli_epi32(e, FswEvcode0::det_id::shift),
+                                        _mm_set1_epi32(FswEvcode0::det_id::mask)), is0);
+    det_id = _mm_blendv_epi8(det_id, _mm_and_si128(_mm_srli_epi32(e, FswEvcode3Add0::det_id::shift),
+                                        _mm_set1_epi32(FswEvcode3Add0::det_id::mask)), add0);
+    // TIME_STAMP: 6 bits (EVCODE 0, 1, 2) or 8 bits (EVCODE 3 / ADD 1)
+    time_stamp = _mm_blendv_epi8(minus1, _mm_and_si128(_mm_srli_epi32(e, FswEvcode0::time_stamp::shift),
+                                        _mm_set1_epi32(FswEvcode0::time_stamp::mask)), is0);
+    time_stamp = _mm_blendv_epi8(time_stamp, _mm_and_si128(_mm_srli_epi32(e, FswEvcode1::time_stamp::shift),
+                                        _mm_set1_epi32(FswEvcode1::time_stamp::mask)), is12);
+    time_stamp = _mm_blendv_epi8(time_stamp, _mm_and_si128(_mm_srli_epi32(e, FswEvcode3Add1::time_stamp::shift),
+                                        _mm_set1_epi32(FswEvcode3Add1::time_stamp::mask)), add1);
+    // DATA: always the low bits; only the width depends on the event type
+    __m128i mask = _mm_blendv_epi8(_mm_set1_epi32(FswEvcode3Add1::data::mask),
+                                   _mm_set1_epi32(FswEvcode3Add0::data::mask), add0);
+    mask = _mm_blendv_epi8(mask, _mm_set1_epi32(FswEvcode1::data::mask), is12);
+    mask = _mm_blendv_epi8(mask, _mm_set1_epi32(FswEvcode0::data::mask), is0);
+    data = _mm_and_si128(e, mask);
+}
+
+__attribute__((target("sse4.1")))
+inline void UnpackFrame_SSE4(const uint8_t frame[], EventBatch &out) {
+    // bytes of reports 0..3 of a 10-byte group, one report per lane
+    const __m128i gather = _mm_setr_epi8(0,1,2,-1, 2,3,4,-1, 5,6,7,-1, 7,8,9,-1);
+    const __m128i mask20 = _mm_set1_epi32(0xfffff);
+    __m128i evcode, add, det_id, time_stamp, data;
+
+    uint16_t i = 0;
+    for (; 10*(i/4) + 16 <= frame_bytes; i += 4) {  // (16-byte loads stay in the frame)
+        __m128i raw = _mm_loadu_si128((const __m128i *)(frame + 10*(i/4)));
+        __m128i e = _mm_shuffle_epi8(raw, gather);
+        e = _mm_blend_epi16(e, _mm_srli_epi32(e, 4), 0xcc);    // (odd reports start mid-byte)
+        e = _mm_and_si128(e, mask20);
+        DecodeLanes_SSE4(e, evcode, add, det_id, time_stamp, data);
+        _mm_storel_epi64((__m128i *)(out.evcode + i), _mm_packs_epi32(evcode, evcode));
+        _mm_storel_epi64((__m128i *)(out.add + i), _mm_packs_epi32(add, add));
+        _mm_storel_epi64((__m128i *)(out.det_id + i), _mm_packs_epi32(det_id, det_id));
+        _mm_storel_epi64((__m128i *)(out.time_stamp + i), _mm_packs_epi32(time_stamp, time_stamp));
+        _mm_storeu_si128((__m128i *)(out.data + i), data);
+    }
+    UnpackTail(frame, out, i);
+}
+
+
+// ---------------------------------------------------------------------
+// AVX2: 8 events (20 bytes) per step
+// ---------------------------------------------------------------------
+
+__attribute__((target("avx2")))
+inline void DecodeLanes_AVX2(__m256i e, __m256i &evcode, __m256i &add, __m256i &det_id,
+                             __m256i &time_stamp, __m256i &data) {
+    const __m256i zero   = _mm256_setzero_si256();
+    const __m256i one    = _mm256_set1_epi32(1);
+    const __m256i minus1 = _mm256_set1_epi32(-1);
+
+    evcode = _mm256_srli_epi32(e, FswEvCode::shift);
+    __m256i is0  = _mm256_cmpeq_epi32(evcode, zero);
+    __m256i is3  = _mm256_cmpeq_epi32(evcode, _mm256_set1_epi32(3));
+    __m256i is12 = _mm256_andnot_si256(_mm256_or_si256(is0, is3), minus1);
+    __m256i addb = _mm256_and_si256(_mm256_srli_epi32(e, FswAdd::shift), one);
+    __m256i add1 = _mm256_and_si256(is3, _mm256_cmpeq_epi32(addb, one));
+    __m256i add0 = _mm256_andnot_si256(add1, is3);
+
+    add = _mm256_blendv_epi8(minus1, addb, is3);
+    det_id = _mm256_blendv_epi8(minus1, _mm256_and_si256(_mm256_srli_epi32(e, FswEvcode0::det_id::shift),
+                                        _mm256_set1_epi32(FswEvcode0::det_id::mask)), is0);
+    det_id = _mm256_blendv_epi8(det_id, _mm256_and_si256(_mm256_srli_epi32(e, FswEvcode3Add0::det_id::shift),
+                                        _mm256_set1_epi32(FswEvcode3Add0::det_id::mask)), add0);
+    time_stamp = _mm256_blendv_epi8(minus1, _mm256_and_si256(_mm256_srli_epi32(e, FswEvcode0::time_stamp::shift),
+                                        _mm256_set1_epi32(FswEvcode0::time_stamp::mask)), is0);
+    time_stamp = _mm256_blendv_epi8(time_stamp, _mm256_and_si256(_mm256_srli_epi32(e, FswEvcode1::time_stamp::shift),
+                                        _mm256_set1_epi32(FswEvcode1::time_stamp::mask)), is12);
+    time_stamp = _mm256_blendv_epi8(time_stamp, _mm256_and_si256(_mm256_srli_epi32(e, FswEvcode3Add1::time_stamp::shift),
+                                        _mm256_set1_epi32(FswEvcode3Add1::time_stamp::mask)), add1);
+    __m256i mask = _mm256_blendv_epi8(_mm256_set1_epi32(FswEvcode3Add1::data::mask),
+                                      _mm256_set1_epi32(FswEvcode3Add0::data::mask), add0);
+    mask = _mm256_blendv_epi8(mask, _mm256_set1_epi32(FswEvcode1::data::mask), is12);
+    mask = _mm256_blendv_epi8(mask, _mm256_set1_epi32(FswEvcode0::data::mask), is0);
+    data = _mm256_and_si256(e, mask);
+}
+
+// narrow eight 32-bit lanes to int16 and store them
+__attribute__((target("avx2")))
+inline void Store16_AVX2(int16_t *dst, __m256i v) {
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(v, v), 0x08);
+    _mm_storeu_si128((__m128i *)dst, _mm256_castsi256_si128(packed));
+}
+
+__attribute__((target("avx2")))
+inline void UnpackFrame_AVX2(const uint8_t frame[], EventBatch &out) {
+    // same gather in both 128-bit halves (each half holds one 10-byte group)
+    const __m256i gather = _mm256_setr_epi8(0,1,2,-1, 2,3,4,-1, 5,6,7,-1, 7,8,9,-1,
+                                            0,1,2,-1, 2,3,4,-1, 5,6,7,-1, 7,8,9,-1);
+    const __m256i shifts = _mm256_setr_epi32(0,4,0,4, 0,4,0,4);
+    const __m256i mask20 = _mm256_set1_epi32(0xfffff);
+    __m256i evcode, add, det_id, time_stamp, data;
+
+    uint16_t i = 0;
+    for (; 20*(i/8) + 10 + 16 <= frame_bytes; i += 8) {
+        const uint8_t *group = frame + 20*(i/8);
+        __m256i raw = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)group)),
+                _mm_loadu_si128((const __m128i *)(group + 10)), 1);
+        __m256i e = _mm256_shuffle_epi8(raw, gather);
+        e = _mm256_and_si256(_mm256_srlv_epi32(e, shifts), mask20);
+        DecodeLanes_AVX2(e, evcode, add, det_id, time_stamp, data);
+        Store16_AVX2(out.evcode + i, evcode);
+        Store16_AVX2(out.add + i, add);
+        Store16_AVX2(out.det_id + i, det_id);
+        Store16_AVX2(out.time_stamp + i, time_stamp);
+        _mm256_storeu_si256((__m256i *)(out.data + i), data);
+    }
+    UnpackTail(frame, out, i);
+}
+#endif
+
+
+// ---------------------------------------------------------------------
+// RUNTIME SELECTION
+// ---------------------------------------------------------------------
+
+typedef void (*FrameKernel)(const uint8_t frame[], EventBatch &out);
+
+struct FrameKernelInfo {
+    const char  *name;
+    FrameKernel kernel;
+};
+
+// fastest kernel this CPU supports (or the one named by $STEIN_KERNEL)
+inline FrameKernelInfo SelectFrameKernel() {
+    FrameKernelInfo scalar = { "scalar", UnpackFrame_Scalar };
+    const char *forced = getenv("STEIN_KERNEL");
+    if (forced && strcmp(forced, "scalar") == 0) return scalar;
+#ifdef STEIN_KERNEL_X86
+    __builtin_cpu_init();
+    FrameKernelInfo avx2 = { "avx2", UnpackFrame_AVX2 };
+    FrameKernelInfo sse4 = { "sse4", UnpackFrame_SSE4 };
+    bool has_avx2 = __builtin_cpu_supports("avx2");
+    bool has_sse4 = __builtin_cpu_supports("sse4.1");
+    if (forced && strcmp(forced, "sse4") == 0 && has_sse4) return sse4;
+    if (has_avx2 && !(forced && strcmp(forced, "sse4") == 0)) return avx2;
+    if (has_sse4) return sse4;
+#endif
+    return scalar;
+}
+
+static const FrameKernelInfo frame_kernel = SelectFrameKernel();
+
+// unpack and decode all events of one STEIN frame
+inline void UnpackFrame(const uint8_t frame[], EventBatch &out) {
+    frame_kernel.kernel(frame, out);
+}
+
+#endif
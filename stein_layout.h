@@ -0,0 +1,220 @@
+//
+// stein_layout.h -- compile-time descriptions of the STEIN event-report
+//  bit layouts, and the decoders generated from them.
+//
+// Each layout lists where its five fields (EVCODE, ADD, DET_ID,
+//  TIME_STAMP, DATA) sit in the event word.  Fields a layout does not
+//  carry are Absent and decode to -1.  FSW reports are 20 bits wide, and
+//  their fields are given as (offset from the MSB, width), as in the FSW
+//  documentation; raw STEIN records are 32-bit big-endian words.
+//
+//    layout              EVCODE  ADD   DET_ID  TIME_STAMP  DATA
+//    FSW evcode 0        2       -     5       6 (2 LSB    7 (log-binned)
+//                                              dropped)
+//    FSW evcode 1, 2     2       -     -       6           12
+//    FSW evcode 3/ADD 0  2       1     1       -           16
+//    FSW evcode 3/ADD 1  2       1     -       8           9
+//    raw 32-bit          2       1     5       8           16 (offset binary)
+//
+// The decoders below are generated from these descriptors: the FSW
+//  decoder turns the five FSW layouts into a constant table of shifts,
+//  masks and fill values, and picks a row by EVCODE and ADD bit instead of
+//  branching.  The raw decoder is a fixed sequence of shifts and masks.
+//  Supporting a new firmware layout means adding or editing a descriptor
+//  here; the hot loops (stein_kernel.h, rawstein_extract.cpp) and the IDL
+//  PARSE_EVENTREPORT (fsw_steinunpack.pro) follow this file.
+//
+//
+// Copyright 2013 Karl Yando
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef STEIN_LAYOUT_H
+#define STEIN_LAYOUT_H
+
+#include <stdint.h>
+
+// a field of "Bits" bits, "Shift" bits above the LSB of the word; "Flip"
+//   is XOR-ed into the extracted value (e.g. to re-bias offset binary)
+template <unsigned Shift, unsigned Bits, uint32_t Flip = 0>
+struct Field {
+    static const bool       present = true;
+    static const unsigned   shift = Shift;
+    static const uint32_t   mask = (Bits >= 32) ? 0xffffffffu : ((1u << Bits) - 1);
+    static const uint32_t   flip = Flip;
+    static inline int32_t Get(uint32_t word) { return (int32_t)(((word >> Shift) & mask) ^ Flip); }
+    static inline uint32_t Put(int32_t value) { return (((uint32_t)value ^ Flip) & mask) << Shift; }
+};
+
+// a field the layout does not carry (decodes to -1)
+struct Absent {
+    static const bool       present = false;
+    static const unsigned   shift = 0;
+    static const uint32_t   mask = 0;
+    static const uint32_t   flip = 0;
+    static inline int32_t Get(uint32_t) { return -1; }
+    static inline uint32_t Put(int32_t) { return 0; }
+};
+
+// a field of a 20-bit FSW report, "Offset" bits below the report's MSB
+template <unsigned Offset, unsigned Bits>
+struct FswField : Field<20 - (Offset + Bits), Bits> {};
+
+template <class EvCode, class Add, class DetId, class TimeStamp, class Data>
+struct EventLayout {
+    typedef EvCode      evcode;
+    typedef Add         add;
+    typedef DetId       det_id;
+    typedef TimeStamp   time_stamp;
+    typedef Data        data;
+
+    static inline void Decode(uint32_t word, int32_t &ev, int32_t &ad, int32_t &det,
+                              int32_t &ts, int32_t &dat) {
+        ev  = EvCode::Get(word);
+        ad  = Add::Get(word);
+        det = DetId::Get(word);
+        ts  = TimeStamp::Get(word);
+        dat = Data::Get(word);
+    }
+
+    // the inverse of Decode() (absent fields are ignored), e.g. to build
+    //   synthetic data
+    static inline uint32_t Encode(int32_t ev, int32_t ad, int32_t det, int32_t ts, int32_t dat) {
+        return EvCode::Put(ev) | Add::Put(ad) | DetId::Put(det) | TimeStamp::Put(ts)
+             | Data::Put(dat);
+    }
+};
+
+
+// ---------------------------------------------------------------------
+// FSW 20-bit event reports
+// ---------------------------------------------------------------------
+
+typedef FswField<0, 2> FswEvCode;
+typedef FswField<2, 1> FswAdd;          // (EVCODE 3 only)
+
+// EVCODE 0: data event (DATA log-binned to 7 bits)
+typedef EventLayout<FswEvCode, Absent, FswField<2,5>, FswField<7,6>, FswField<13,7> >
+        FswEvcode0;
+// EVCODE 1: sweep checksum / # of triggers per second
+typedef EventLayout<FswEvCode, Absent, Absent, FswField<2,6>, FswField<8,12> >
+        FswEvcode1;
+// EVCODE 2: sweep checksum / # of events per second
+typedef EventLayout<FswEvCode, Absent, Absent, FswField<2,6>, FswField<8,12> >
+        FswEvcode2;
+// EVCODE 3, ADD 0: noise event
+typedef EventLayout<FswEvCode, FswAdd, FswField<3,1>, Absent, FswField<4,16> >
+        FswEvcode3Add0;
+// EVCODE 3, ADD 1: status event
+typedef EventLayout<FswEvCode, FswAdd, Absent, FswField<3,8>, FswField<11,9> >
+        FswEvcode3Add1;
+
+// one row of the generated decode table
+struct FieldRow {
+    uint8_t     shift[5];
+    uint32_t    mask[5];
+    int32_t     fill[5];                // OR-ed in: -1 for absent fields
+};
+
+template <class F>
+constexpr void SetField(FieldRow &row, int f) {
+    row.shift[f] = F::shift;
+    row.mask[f] = F::mask;
+    row.fill[f] = F::present ? 0 : -1;
+}
+
+template <class L>
+constexpr FieldRow MakeRow() {
+    FieldRow row = {};
+    SetField<typename L::evcode>(row, 0);
+    SetField<typename L::add>(row, 1);
+    SetField<typename L::det_id>(row, 2);
+    SetField<typename L::time_stamp>(row, 3);
+    SetField<typename L::data>(row, 4);
+    return row;
+}
+
+// rows indexed by FswLayoutIndex(): EVCODE 0, 1, 2, 3/ADD 0, 3/ADD 1
+struct FswTable {
+    FieldRow row[5];
+    constexpr FswTable() : row{ MakeRow<FswEvcode0>(), MakeRow<FswEvcode1>(),
+                                MakeRow<FswEvcode2>(), MakeRow<FswEvcode3Add0>(),
+                                MakeRow<FswEvcode3Add1>() } {}
+};
+static constexpr FswTable fsw_table;
+
+inline unsigned FswLayoutIndex(uint32_t report) {
+    unsigned evcode = FswEvCode::Get(report);
+    return evcode + ((evcode == 3) & FswAdd::Get(report));
+}
+
+// decode one 20-bit FSW report (branch-free: one table row per layout)
+inline void DecodeFswEvent(uint32_t report, int16_t &evcode, int16_t &add, int16_t &det_id,
+                           int16_t &time_stamp, int32_t &data) {
+    const FieldRow &r = fsw_table.row[FswLayoutIndex(report)];
+    evcode     = (int16_t)(((report >> r.shift[0]) & r.mask[0]) | r.fill[0]);
+    add        = (int16_t)(((report >> r.shift[1]) & r.mask[1]) | r.fill[1]);
+    det_id     = (int16_t)(((report >> r.shift[2]) & r.mask[2]) | r.fill[2]);
+    time_stamp = (int16_t)(((report >> r.shift[3]) & r.mask[3]) | r.fill[3]);
+    data       = (int32_t)(((report >> r.shift[4]) & r.mask[4]) | r.fill[4]);
+}
+
+// FSW log-binning of EVCODE 0 DATA (as in EX_PLOT_RAW, stein_simfsw.pro):
+//   the 8 LSBs of the 16-bit ADC value are dropped, and the upper 8 bits
+//   are binned to 7 bits, [7-bit value] = (UPPER 6 BITS)(LSB):
+//      0 ..  63  ->  (upper8 AND 63) << 1     (LSB 0: 0-64 keV, 1 keV bins)
+//     64 .. 127  ->  (upper8 AND 62) OR 1     (LSB 1: 64-190 keV, 2 keV bins)
+//    128 .. 191  ->  (upper8 AND 62) OR 65
+//    192 ..      ->  127                      (190 keV+, integral bin)
+//   "kev" is the lower edge of each 7-bit bin, as in LOG_UNPACK
+//   (stein_actions.pro)
+struct FswLogTables {
+    uint8_t     bin [256];              // (indexed by ADC value >> 8)
+    int16_t     kev [128];              // (indexed by 7-bit value)
+
+    constexpr FswLogTables() : bin(), kev() {
+        for (unsigned u=0; u < 256; u++) {
+            bin[u] = (u < 64)  ? (u & 63) << 1
+                   : (u < 128) ? (u & 62) | 1
+                   : (u < 192) ? (u & 62) | 65 : 127;
+        }
+        for (unsigned v=0; v < 128; v++) {
+            kev[v] = (v & 1) ? (v >> 1)*2 + 64 : (v >> 1);
+        }
+    }
+};
+static constexpr FswLogTables fsw_log;
+
+
+// ---------------------------------------------------------------------
+// raw 32-bit STEIN records
+// ---------------------------------------------------------------------
+
+// EVCODE(1:0) ADD(0) DET_ID(4:0) [1st byte], TIME_STAMP(7:0) [2nd byte],
+//   DATA(15:0) [3rd + 4th bytes; signed as received, re-biased to unsigned
+//   by flipping the MSB (i.e. adding 32768 modulo 2^16)]
+typedef EventLayout<Field<30,2>, Field<29,1>, Field<24,5>, Field<16,8>, Field<0,16,0x8000> >
+        RawLayout;
+
+inline uint32_t RawWord(const uint8_t record[4]) {
+    return ((uint32_t)record[0] << 24) | ((uint32_t)record[1] << 16)
+         | ((uint32_t)record[2] << 8) | (uint32_t)record[3];
+}
+
+inline void DecodeRawEvent(const uint8_t record[4], int32_t &evcode, int32_t &add,
+                           int32_t &det_id, int32_t &time_stamp, int32_t &data) {
+    RawLayout::Decode(RawWord(record), evcode, add, det_id, time_stamp, data);
+}
+
+#endif
@@ -0,0 +1,235 @@
+//
+// stein_options.h -- command-line options shared by fsw_steinunpack and
+//  rawstein_extract.  Each tool walks its argument list, offering every
+//  argument to ParseCommonOption() before its own options; anything not
+//  starting with "-" (or "-" alone, standard input) is taken as the data
+//  file.
+//
+//    --format=text       ASCII event list (default)
+//    --format=columnar   binary column-oriented event list (stein_columnar.h)
+//    --histogram         counts by EVCODE / ADD / DET_ID / DATA bin in place
+//                        of the event list (stein_histogram.h)
+//    --window=N          with --histogram: a separate table every N frames
+//    --window=@S         with --histogram: a separate table every S seconds
+//                        of packet time (FSW dumps)
+//    --coincidence=W     the DET_ID x DET_ID matrix of EVCODE 0 hits at most
+//                        W TIME_STAMP counts apart, in place of the event
+//                        list (stein_coincidence.h)
+//    --coincidence-groups=W
+//                        the same search, listing each group of coincident
+//                        hits instead
+//    --kev               (text output) a 7th column, the keV lower bin edge of
+//                        EVCODE 0 log-binned DATA (LOG_UNPACK; -1 otherwise)
+//    --follow            keep decoding the data file as it grows (or the
+//                        pipe as data arrives) until SIGINT / SIGTERM;
+//                        "-" reads standard input (stein_input.h)
+//    --no-decompress     read the data file as it is, even if it looks
+//                        compressed (stein_input.h)
+//    --evcode=SET, --add=SET, --det-id=SET
+//                        keep only events with these values ("0,2",
+//                        "0..7,12"; stein_filter.h)
+//    --time-stamp=A..B, --frames=A..B
+//                        keep only events in this TIME_STAMP / frame range
+//    --stats             a JSON summary of the run on stderr: stage times,
+//                        counts per EVCODE / DET_ID, invalid input, peak
+//                        memory (stein_stats.h)
+//    --stats=FILE        the same, to FILE alone
+//    -j N, --jobs=N      decode on N threads (0 = one per CPU); output order
+//                        and event numbering are unchanged (stein_pipeline.h)
+//    --output-dir=DIR    (batch runs) one output file per input in DIR,
+//                        instead of one merged stream (stein_batch.h)
+//
+//
+// Copyright 2013 Karl Yando
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef STEIN_OPTIONS_H
+#define STEIN_OPTIONS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+#include "stein_coincidence.h"
+#include "stein_columnar.h"
+#include "stein_filter.h"
+#include "stein_histogram.h"
+#include "stein_layout.h"
+#include "stein_output.h"
+
+enum OutputFormat { FORMAT_TEXT, FORMAT_COLUMNAR, FORMAT_HISTOGRAM, FORMAT_COINCIDENCE };
+
+struct SteinOptions {
+    OutputFormat    format;
+    unsigned        threads;            // decoding threads
+    uint64_t        window;             // frames per histogram table (0: all)
+    uint64_t        window_ticks;       //   or packet time per table (FSW)
+    bool            kev;                // keV column (text output)
+    bool            follow;             // decode a growing input live
+    bool            decompress;         // decompress compressed inputs
+    EventFilter     filter;             // events to keep (default: all)
+    bool            stats;              // JSON run summary on stderr
+    const char      *stats_file;        //   (or in this file)
+    const char      *output_dir;        // (batch runs) per-file outputs
+    uint32_t        coincidence;        // coincidence window (TIME_STAMP counts)
+    bool            coincidence_groups; // list groups, not the matrix
+    uint32_t        stamp_period;       // EVCODE 0 TIME_STAMP wrap (set by the tool)
+
+    SteinOptions() : format(FORMAT_TEXT), threads(1), window(0), window_ticks(0), kev(false),
+                     follow(false), decompress(true), stats(false), stats_file(NULL), output_dir(NULL), coincidence(0),
+                     coincidence_groups(false),
+                     stamp_period(FswEvcode0::time_stamp::mask + 1) {}
+};
+
+// option "name" with an "=value" suffix; returns the value, or NULL
+inline const char *OptionValue(const char *arg, const char *name) {
+    size_t n = strlen(name);
+    if (strncmp(arg, name, n) == 0 && arg[n] == '=') return arg + n + 1;
+    return NULL;
+}
+
+// try to interpret argv[i] (and any value following it); returns the
+//   number of arguments used, 0 if the option is not a common one, or
+//   -1 if it is malformed (a message has been printed to stderr)
+inline int ParseCommonOption(int argc, char *argv[], int i, SteinOptions &opts) {
+    const char *arg = argv[i];
+    const char *value = NULL;
+    int used = 1;
+
+    if ((value = OptionValue(arg, "--format"))) {
+        if (strcmp(value, "text") == 0) opts.format = FORMAT_TEXT;
+        else if (strcmp(value, "columnar") == 0) opts.format = FORMAT_COLUMNAR;
+        else {
+            fprintf(stderr, "unknown output format: %s\n", value);
+            return -1;
+        }
+        return 1;
+    }
+    if (strcmp(arg, "--histogram") == 0) {
+        opts.format = FORMAT_HISTOGRAM;
+        return 1;
+    }
+    if (strcmp(arg, "--follow") == 0) {
+        opts.follow = true;
+        return 1;
+    }
+    if (strcmp(arg, "--no-decompress") == 0) {
+        opts.decompress = false;
+        return 1;
+    }
+    if (strcmp(arg, "--stats") == 0 || (value = OptionValue(arg, "--stats"))) {
+        opts.stats = true;
+        opts.stats_file = value;
+        return 1;
+    }
+    if (strcmp(arg, "--kev") == 0) {
+        opts.kev = true;
+        return 1;
+    }
+    if ((value = OptionValue(arg, "--output-dir"))) {
+        opts.output_dir = value;
+        return 1;
+    }
+    if ((value = OptionValue(arg, "--window")) && *value == '@') {
+        char *end;
+        double seconds = strtod(value + 1, &end);
+        if (value[1] < '0' || value[1] > '9' || *end != '\0'
+                || !(seconds * packet_time_ticks >= 1)) {
+            fprintf(stderr, "invalid window (seconds of packet time): %s\n", value + 1);
+            return -1;
+        }
+        opts.window = 0;
+        opts.window_ticks = (uint64_t)(seconds * packet_time_ticks + 0.5);
+        return 1;
+    }
+    if (value) {                        // (--window=N)
+        char *end;
+        unsigned long long n = strtoull(value, &end, 10);
+        if (*value < '0' || *value > '9' || *end != '\0' || n == 0) {
+            fprintf(stderr, "invalid window (frames): %s\n", value);
+            return -1;
+        }
+        opts.window = n;
+        opts.window_ticks = 0;
+        return 1;
+    }
+    if ((value = OptionValue(arg, "--coincidence"))
+            || (value = OptionValue(arg, "--coincidence-groups"))) {
+        char *end;
+        unsigned long n = strtoul(value, &end, 10);
+        if (*value < '0' || *value > '9' || *end != '\0' || n > 65535) {
+            fprintf(stderr, "invalid coincidence window (TIME_STAMP counts): %s\n", value);
+            return -1;
+        }
+        opts.format = FORMAT_COINCIDENCE;
+        opts.coincidence = (uint32_t)n;
+        opts.coincidence_groups = (strncmp(arg, "--coincidence-groups", 20) == 0);
+        return 1;
+    }
+    // event filters
+    bool ok = true;
+    if ((value = OptionValue(arg, "--evcode"))) ok = opts.filter.SetEvcodes(value);
+    else if ((value = OptionValue(arg, "--add"))) ok = opts.filter.SetAdds(value);
+    else if ((value = OptionValue(arg, "--det-id"))) ok = opts.filter.SetDetIds(value);
+    else if ((value = OptionValue(arg, "--time-stamp"))) ok = opts.filter.SetTimeStamps(value);
+    else if ((value = OptionValue(arg, "--frames"))) ok = opts.filter.SetFrames(value);
+    if (value) {
+        if (!ok) fprintf(stderr, "invalid filter: %s\n", arg);
+        return ok ? 1 : -1;
+    }
+    // -j N, -jN, --jobs=N
+    if (strncmp(arg, "-j", 2) == 0 || (value = OptionValue(arg, "--jobs"))) {
+        if (arg[1] == 'j') {
+            value = arg + 2;
+            if (*value == '\0') {
+                if (i + 1 >= argc) {
+                    fprintf(stderr, "option -j needs a thread count\n");
+                    return -1;
+                }
+                value = argv[i + 1];
+                used = 2;
+            }
+        }
+        char *end;
+        long n = strtol(value, &end, 10);
+        if (*value == '\0' || *end != '\0' || n < 0) {
+            fprintf(stderr, "invalid thread count: %s\n", value);
+            return -1;
+        }
+        opts.threads = n ? (unsigned)n : std::thread::hardware_concurrency();
+        if (opts.threads == 0) opts.threads = 1;
+        return used;
+    }
+    return 0;
+}
+
+// the event-list output selected by "opts" (writes to "fd", by default
+//   standard out)
+inline EventSink *MakeEventSink(const SteinOptions &opts, int fd = 1) {
+    if (opts.format == FORMAT_COLUMNAR) return new ColumnarWriter(fd);
+    if (opts.format == FORMAT_HISTOGRAM) {
+        return new HistogramSink(fd, opts.window, opts.window_ticks);
+    }
+    if (opts.format == FORMAT_COINCIDENCE) {
+        return new CoincidenceSink(fd, opts.coincidence, opts.stamp_period,
+                                   opts.coincidence_groups);
+    }
+    EventWriter *writer = new EventWriter(fd);
+    if (opts.kev) writer->SetExtraColumn("KEV", fsw_log.kev, 128);
+    return writer;
+}
+
+#endif
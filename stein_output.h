@@ -0,0 +1,295 @@
+//
+// stein_output.h -- buffered, allocation-free writer for the ASCII event
+//  list shared by fsw_steinunpack and rawstein_extract.  Events are
+//  formatted into a large user-space buffer with a digit-pair table and
+//  handed to the kernel only when the buffer fills or the run ends (the
+//  former "cout << ... << endl" flushed stdout once per event).
+//
+// Output is byte-for-byte the established format:
+//
+//    # frame / EVCODE / ADD / DET_ID / TIME_STAMP / DATA
+//    0 2 -1 -1 60 753
+//
+// EventSink is the common interface of every event-list output; the
+//  decoders hand each event to whichever sink the command line selected.
+//  FSW decoders also announce each packet (its time and housekeeping)
+//  before its events, for the PACKET_TIME column ("--packet-time") and the
+//  per-packet time series of stein_timeseries.h.
+//
+//
+// Copyright 2013 Karl Yando
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef STEIN_OUTPUT_H
+#define STEIN_OUTPUT_H
+
+#include <errno.h>
+#include <mutex>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+// "00" "01" ... "99", for emitting two decimal digits at a time
+static const char digit_pairs[201] =
+    "00010203040506070809101112131415161718192021222324"
+    "25262728293031323334353637383940414243444546474849"
+    "50515253545556575859606162636465666768697071727374"
+    "75767778798081828384858687888990919293949596979899";
+
+// write "v" in decimal at "out"; returns the position after the last digit
+inline char *FormatUnsigned(char *out, uint64_t v) {
+    char tmp[20];
+    char *p = tmp + sizeof(tmp);
+    while (v >= 100) {
+        unsigned r = (unsigned)(v % 100);
+        v /= 100;
+        p -= 2;
+        memcpy(p, digit_pairs + 2*r, 2);
+    }
+    if (v >= 10) {
+        p -= 2;
+        memcpy(p, digit_pairs + 2*v, 2);
+    } else {
+        *--p = (char)('0' + v);
+    }
+    size_t n = tmp + sizeof(tmp) - p;
+    memcpy(out, p, n);
+    return out + n;
+}
+
+inline char *FormatSigned(char *out, int64_t v) {
+    if (v < 0) {
+        *out++ = '-';
+        return FormatUnsigned(out, 0 - (uint64_t)v);
+    }
+    return FormatUnsigned(out, (uint64_t)v);
+}
+
+
+// packet time units per second (the FSW packet timestamp counts 1/256 s;
+//   see PacketTime, stein_fsw.h)
+static const uint64_t packet_time_ticks = 256;
+
+// FSW packet time (1/packet_time_ticks s since January 1, 00:00) as seconds
+//   with 5 decimals, "1043.50000", at "out"; returns the position after it
+inline char *FormatPacketTime(char *out, uint64_t time) {
+    out = FormatUnsigned(out, time / packet_time_ticks);
+    *out++ = '.';
+    uint32_t frac = (uint32_t)(time % packet_time_ticks * 100000 / packet_time_ticks);
+    for (int k=4; k >= 0; k--) {
+        out[k] = (char)('0' + frac % 10);
+        frac /= 10;
+    }
+    return out + 5;
+}
+
+
+// format one event-list record, "frame evcode add det_id time_stamp data\n",
+//   at "p" (at most max_event_line bytes); returns the position after it
+static const size_t max_event_line = 128;
+inline char *FormatEventLine(char *p, uint64_t frame, int32_t evcode, int32_t add,
+                             int32_t det_id, int32_t time_stamp, int32_t data) {
+    p = FormatUnsigned(p, frame);       *p++ = ' ';
+    p = FormatSigned(p, evcode);        *p++ = ' ';
+    p = FormatSigned(p, add);           *p++ = ' ';
+    p = FormatSigned(p, det_id);        *p++ = ' ';
+    p = FormatSigned(p, time_stamp);    *p++ = ' ';
+    p = FormatSigned(p, data);          *p++ = '\n';
+    return p;
+}
+
+
+// one FSW packet, as its decoder hands it on (before the packet's events)
+struct PacketInfo {
+    uint64_t    packet;                 // packet number (frames 198*packet ..)
+    uint64_t    time;                   // packet time (1/packet_time_ticks s)
+    uint8_t     housekeeping [8];       // housekeeping subframe, as received
+    uint32_t    det_events [32];        // EVCODE 0 events per DET_ID
+    uint32_t    sweep_sum [2];          // sum of EVCODE 1 / 2 DATA (per-second
+    uint32_t    sweep_n [2];            //   triggers / events), and # of reports
+};
+
+// destination for decoded events
+class EventSink {
+public:
+    virtual ~EventSink() {}
+
+    // one decoded event
+    virtual void Event(uint64_t frame, int32_t evcode, int32_t add, int32_t det_id,
+                       int32_t time_stamp, int32_t data) = 0;
+    // the packet whose events follow (FSW dumps only)
+    virtual void Packet(const PacketInfo &info) { (void)info; }
+    // a "# ..." comment line (ignored by binary outputs)
+    virtual void Comment(const char *text) { (void)text; }
+    // the comment line naming the output's columns
+    virtual void Header() { Comment("# frame / EVCODE / ADD / DET_ID / TIME_STAMP / DATA\n"); }
+    // push anything already buffered to the output
+    virtual void Flush() {}
+    // end of run: complete and flush the output
+    virtual void Finish() { Flush(); }
+    // true once writing the output has failed (check after Finish())
+    virtual bool Failed() const { return false; }
+};
+
+// write all of "len" bytes to "fd"; returns false on error
+inline bool WriteAll(int fd, const void *data, size_t len) {
+    const char *p = (const char *)data;
+    while (len) {
+        ssize_t n = write(fd, p, len);
+        if (n > 0) { p += n; len -= n; }
+        else if (n < 0 && errno == EINTR) continue;
+        else return false;
+    }
+    return true;
+}
+
+
+// ASCII event list
+class EventWriter : public EventSink {
+public:
+    static const size_t default_size = 1UL << 20;
+    static const size_t max_line = max_event_line;
+
+    explicit EventWriter(int fd = 1, size_t size = default_size)
+        : fd(fd), size(size < 2*max_line ? 2*max_line : size), used(0), failed(false),
+          extra_name(NULL), extra(NULL), n_extra(0), time_column(false), packet_time(0),
+          source(-1), shared(NULL) {
+        buffer = new char [this->size];
+    }
+    ~EventWriter() {
+        Flush();
+        delete[] buffer;
+    }
+
+    // add a 7th column "name", looked up as table[DATA] for EVCODE 0
+    //   events (0 <= DATA < n) and -1 otherwise (e.g. keV, see --kev)
+    void SetExtraColumn(const char *name, const int16_t *table, int32_t n) {
+        extra_name = name;
+        extra = table;
+        n_extra = n;
+    }
+
+    // add a PACKET_TIME column (after any 7th column): the time of the
+    //   FSW packet each event came from, in seconds (see --packet-time)
+    void SetTimeColumn(bool on) { time_column = on; }
+    bool TimeColumn() const { return time_column; }
+
+    // add a SOURCE column (last): "id", the input file the events came
+    //   from, when several inputs share one event list (batch runs)
+    void SetSourceColumn(int64_t id) { source = id; }
+
+    // several writers share "fd" (batch runs): each one writes only whole
+    //   lines, under "lock"
+    void SetShared(std::mutex *lock) { shared = lock; }
+
+    // format one record at "p" as Event() writes it (at most max_line
+    //   bytes; "time" is the packet time); returns the position after it
+    char *Format(char *p, uint64_t frame, int32_t evcode, int32_t add, int32_t det_id,
+                 int32_t time_stamp, int32_t data, uint64_t time = 0) const {
+        p = FormatEventLine(p, frame, evcode, add, det_id, time_stamp, data);
+        if (extra) {
+            p[-1] = ' ';
+            p = FormatSigned(p, (evcode == 0 && data >= 0 && data < n_extra) ? extra[data] : -1);
+            *p++ = '\n';
+        }
+        if (time_column) {
+            p[-1] = ' ';
+            p = FormatPacketTime(p, time);
+            *p++ = '\n';
+        }
+        if (source >= 0) {
+            p[-1] = ' ';
+            p = FormatUnsigned(p, source);
+            *p++ = '\n';
+        }
+        return p;
+    }
+
+    void Packet(const PacketInfo &info) { packet_time = info.time; }
+
+    // one event-list record: "frame evcode add det_id time_stamp data\n"
+    void Event(uint64_t frame, int32_t evcode, int32_t add, int32_t det_id,
+               int32_t time_stamp, int32_t data) {
+        if (size - used < max_line) Flush();
+        used = Format(buffer + used, frame, evcode, add, det_id, time_stamp, data,
+                      packet_time) - buffer;
+    }
+
+    void Header() {
+        Write("# frame / EVCODE / ADD / DET_ID / TIME_STAMP / DATA");
+        if (extra) {
+            Write(" / ");
+            Write(extra_name);
+        }
+        if (time_column) Write(" / PACKET_TIME");
+        if (source >= 0) Write(" / SOURCE");
+        Write("\n");
+    }
+
+    // verbatim text (comment/header lines, pre-formatted blocks of events);
+    //   a block is never split between two writes to the output
+    void Write(const char *text, size_t len) {
+        if (len > size - used) Flush();
+        if (len >= size) {              // (large blocks bypass the buffer)
+            Put(text, len);
+            return;
+        }
+        memcpy(buffer + used, text, len);
+        used += len;
+    }
+    void Write(const char *text) { Write(text, strlen(text)); }
+
+    void Comment(const char *text) { Write(text); }
+
+    void Flush() {
+        if (used) Put(buffer, used);
+        used = 0;
+    }
+
+    // true once a write to the output has failed
+    bool Failed() const { return failed; }
+
+private:
+    int     fd;
+    size_t  size;
+    size_t  used;
+    char    *buffer;
+    bool    failed;
+
+    const char      *extra_name;
+    const int16_t   *extra;
+    int32_t         n_extra;
+    bool            time_column;
+    uint64_t        packet_time;        // (of the events being written)
+    int64_t         source;             // (SOURCE column, or -1)
+    std::mutex      *shared;            // (fd shared with other writers)
+
+    void Put(const char *text, size_t len) {
+        if (failed) return;
+        bool ok;
+        if (shared) {
+            std::lock_guard<std::mutex> lock(*shared);
+            ok = WriteAll(fd, text, len);
+        } else {
+            ok = WriteAll(fd, text, len);
+        }
+        if (!ok) failed = true;             // (e.g. closed pipe)
+    }
+
+    EventWriter(const EventWriter &);
+    EventWriter &operator=(const EventWriter &);
+};
+
+#endif
@@ -0,0 +1,518 @@
+//
+// stein_pipeline.h -- chunked, optionally multi-threaded decode loop shared
+//  by fsw_steinunpack and rawstein_extract.
+//
+// The input is cut into chunks at record boundaries (a packet line for
+//  FSW dumps, a 4-byte event for raw data).  Every record stands alone, so
+//  the chunks can be decoded independently: with "-j N" they go to a pool
+//  of N worker threads, and the results are handed to the output strictly
+//  in input order.  The main thread numbers each chunk before it is
+//  dispatched (from a cheap record count), so global event numbering comes
+//  out exactly as in a single-threaded run.
+//
+// Events the run filters out (stein_filter.h) are dropped by the decoder,
+//  so they never reach a worker's result or the output; frame numbers
+//  still count them.
+//
+// FSW packet records (time, housekeeping, rate counts) travel with the
+//  events and reach the run's PacketSeries (stein_timeseries.h) in input
+//  order too.
+//
+// With --stats, each chunk's counters and decode time are kept with the
+//  chunk and added to the run's RunStats as it is emitted (stein_stats.h).
+//
+// For ASCII output the workers also format their events, so the main
+//  thread only copies finished text to the output; other outputs receive
+//  each chunk's events in order.  At most 2*N chunks are in flight, which
+//  bounds memory use.  The main thread reads input and writes output while
+//  the N workers decode; with N = 1 no threads are started and chunks are
+//  decoded straight into the output.
+//
+// Batch runs (stein_batch.h) decode many files at once on one TaskPool
+//  instead: each file's pipeline queues its chunks on its own thread's
+//  deque, and a thread with nothing of its own to do steals the oldest
+//  chunk of another.  A thread waiting for its next chunk helps decode
+//  whatever is queued, so one large file is spread over every thread
+//  once the small files are done.
+//
+//
+// Copyright 2013 Karl Yando
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef STEIN_PIPELINE_H
+#define STEIN_PIPELINE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string.h>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "stein_filter.h"
+#include "stein_input.h"
+#include "stein_output.h"
+#include "stein_stats.h"
+#include "stein_timeseries.h"
+
+// the format-specific part of the pipeline
+class ChunkDecoder {
+public:
+    ChunkDecoder() : filter(NULL) {}
+    virtual ~ChunkDecoder() {}
+
+    // drop events that fail "f" as they are decoded (NULL: keep all)
+    void SetFilter(const EventFilter *f) { filter = f; }
+
+    // length of the first chunk in data[0 .. avail): ideally about "want"
+    //   bytes, ending on a record boundary.  "at_eof" is true when no more
+    //   input follows "avail".  Returns 0 if no complete record is present.
+    virtual size_t ChunkLength(const uint8_t *data, size_t avail, size_t want,
+                               bool at_eof) const = 0;
+    // number of event-list frames a chunk will produce; also sets
+    //   "n_lines" to the number of text lines in it (0 for binary input)
+    virtual uint64_t CountEvents(const uint8_t *data, size_t len, uint64_t &n_lines) const = 0;
+    // decode a chunk, numbering its events from "first_frame" (and its
+    //   lines, for messages, from "first_line"); with --stats, tally what
+    //   was decoded in "counts" (else NULL)
+    virtual void Decode(const uint8_t *data, size_t len, uint64_t first_frame,
+                        uint64_t first_line, EventSink &sink, DecodeCounts *counts) const = 0;
+
+protected:
+    const EventFilter   *filter;
+};
+
+// ChunkDecoder::ChunkLength() for line-oriented input: chunks end after a
+//   newline (or at the end of the input)
+inline size_t LineChunkLength(const uint8_t *data, size_t avail, size_t want, bool at_eof) {
+    size_t n = (avail < want) ? avail : want;
+    const uint8_t *nl = (const uint8_t *)memrchr(data, '\n', n);
+    if (!nl) nl = (const uint8_t *)memchr(data + n, '\n', avail - n);
+    if (nl) return nl - data + 1;
+    return at_eof ? avail : 0;
+}
+
+
+// one decoded event (kept when a worker feeds a non-text output)
+struct SteinEvent {
+    uint64_t    frame;
+    int16_t     evcode, add, det_id, time_stamp;
+    int32_t     data;
+};
+
+// a worker's output for one chunk: ASCII text, or the events themselves
+//   and the packets they came from (text keeps packets only if the run
+//   keeps a PacketSeries)
+class ChunkResult : public EventSink {
+public:
+    // (text: the ASCII output the events will be formatted for, or NULL)
+    ChunkResult(const EventWriter *text, bool keep_packets)
+        : format(text), text_used(0), keep_packets(keep_packets || !text), packet_time(0) {}
+
+    void Packet(const PacketInfo &info) {
+        packet_time = info.time;
+        if (keep_packets) packets.push_back(std::make_pair(events.size(), info));
+    }
+
+    void Event(uint64_t frame, int32_t evcode, int32_t add, int32_t det_id,
+               int32_t time_stamp, int32_t data) {
+        if (format) {
+            if (text.size() - text_used < EventWriter::max_line) {
+                text.resize(text.size() ? 2 * text.size() : (1 << 16));
+            }
+            text_used = format->Format(&text[text_used], frame, evcode, add, det_id,
+                                       time_stamp, data, packet_time) - &text[0];
+        } else {
+            SteinEvent e = { frame, (int16_t)evcode, (int16_t)add, (int16_t)det_id,
+                             (int16_t)time_stamp, data };
+            events.push_back(e);
+        }
+    }
+
+    // hand the result to the real output (and packets to "series")
+    void Emit(EventSink &output, EventWriter *writer, PacketSeries *series) {
+        if (format) {
+            writer->Write(&text[0], text_used);
+            for (size_t k=0; k < packets.size(); k++) series->Add(packets[k].second);
+            return;
+        }
+        size_t k = 0;
+        for (size_t i=0; i < events.size(); i++) {
+            for (; k < packets.size() && packets[k].first == i; k++) {
+                output.Packet(packets[k].second);
+                if (series) series->Add(packets[k].second);
+            }
+            const SteinEvent &e = events[i];
+            output.Event(e.frame, e.evcode, e.add, e.det_id, e.time_stamp, e.data);
+        }
+        for (; k < packets.size(); k++) {
+            output.Packet(packets[k].second);
+            if (series) series->Add(packets[k].second);
+        }
+    }
+
+    const EventWriter       *format;
+    std::vector<char>       text;
+    size_t                  text_used;
+    std::vector<SteinEvent> events;
+    bool                    keep_packets;
+    uint64_t                packet_time;    // (of the events being added)
+    std::vector<std::pair<size_t, PacketInfo> > packets;   // (before event #)
+};
+
+// with -j 1, passes events to the output and packets to both the output
+//   and the run's PacketSeries
+class PacketTee : public EventSink {
+public:
+    PacketTee(EventSink &output, PacketSeries *series) : output(output), series(series) {}
+
+    void Event(uint64_t frame, int32_t evcode, int32_t add, int32_t det_id,
+               int32_t time_stamp, int32_t data) {
+        output.Event(frame, evcode, add, det_id, time_stamp, data);
+    }
+    void Packet(const PacketInfo &info) {
+        output.Packet(info);
+        series->Add(info);
+    }
+
+private:
+    EventSink       &output;
+    PacketSeries    *series;
+};
+
+
+// work-stealing pool for batch runs: a deque of tasks per thread; a
+//   thread takes its own newest task, or else steals another's oldest
+class TaskPool {
+public:
+    typedef std::function<void ()> Task;
+
+    explicit TaskPool(unsigned n_threads) : n_queued(0), stopping(false) {
+        for (unsigned t=0; t < (n_threads ? n_threads : 1); t++) {
+            queues.push_back(std::unique_ptr<Queue>(new Queue));
+        }
+    }
+
+    unsigned Size() const { return queues.size(); }
+
+    // queue "task" on thread "self"'s deque
+    void Push(unsigned self, const Task &task) {
+        {
+            std::lock_guard<std::mutex> lock(queues[self]->mutex);
+            queues[self]->tasks.push_back(task);
+        }
+        {
+            std::lock_guard<std::mutex> lock(idle_mutex);
+            n_queued++;
+        }
+        available.notify_one();
+    }
+
+    // run one queued task as thread "self"; returns false if there was none
+    bool RunOne(unsigned self) {
+        Task task;
+        unsigned n = queues.size();
+        for (unsigned k=0; k < n && !task; k++) {
+            Queue &q = *queues[(self + k) % n];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            if (q.tasks.empty()) continue;
+            if (k == 0) {                       // (own: newest first)
+                task = q.tasks.back();
+                q.tasks.pop_back();
+            } else {                            // (steal: oldest first)
+                task = q.tasks.front();
+                q.tasks.pop_front();
+            }
+        }
+        if (!task) return false;
+        n_queued--;
+        task();
+        return true;
+    }
+
+    // wait until a task is queued (true) or Stop() is called (false)
+    bool Wait() {
+        std::unique_lock<std::mutex> lock(idle_mutex);
+        available.wait(lock, [this] { return stopping || n_queued > 0; });
+        return n_queued > 0 || !stopping;
+    }
+
+    // wake every waiting thread for good
+    void Stop() {
+        {
+            std::lock_guard<std::mutex> lock(idle_mutex);
+            stopping = true;
+        }
+        available.notify_all();
+    }
+
+private:
+    struct Queue {
+        std::mutex          mutex;
+        std::deque<Task>    tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue> >    queues;
+    std::mutex                  idle_mutex;
+    std::condition_variable     available;
+    std::atomic<long>           n_queued;
+    bool                        stopping;
+
+    TaskPool(const TaskPool &);
+    TaskPool &operator=(const TaskPool &);
+};
+
+
+class DecodePipeline {
+public:
+    static const size_t chunk_size = 1UL << 20;     // (bytes of input)
+
+    DecodePipeline(const ChunkDecoder &decoder, EventSink &output, unsigned n_threads)
+        : decoder(decoder), output(output), n_threads(n_threads ? n_threads : 1),
+          writer(dynamic_cast<EventWriter *>(&output)), stats(NULL), series(NULL), pool(NULL),
+          self(0), stopping(false),
+          n_events(0), n_lines(0) {}
+
+    // collect run statistics in "run" (before the first chunk)
+    void SetStats(RunStats *run) { stats = run; }
+
+    // hand every decoded packet to "s", in input order (before the first
+    //   chunk)
+    void SetPacketSeries(PacketSeries *s) { series = s; }
+
+    // decode on the threads of "p" (batch runs), as its thread "me"
+    //   (before the first chunk)
+    void SetTaskPool(TaskPool *p, unsigned me) {
+        pool = p;
+        self = me;
+        n_threads = p->Size();
+    }
+
+    // number events from "frame", and lines from "line", on (e.g. when
+    //   decoding part of a file)
+    void SetFirstFrame(uint64_t frame, uint64_t line = 0) {
+        n_events = frame;
+        n_lines = line;
+    }
+
+    // decode all of "input"; returns the number of event-list frames
+    //   (counting from frame 0, see SetFirstFrame()).  A
+    //   followed input is decoded as it arrives, and everything decoded so
+    //   far is written out whenever the input goes quiet.
+    uint64_t Run(InputSource &input) {
+        while (true) {
+            std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+            bool more = input.Fill();
+            if (stats) stats->read_seconds += StatSeconds(t0);
+            // (a record cut short by a stop signal is not decoded)
+            bool at_eof = !more && !input.Stopped();
+            while (input.Available()) {
+                const uint8_t *data = input.Data();
+                size_t avail = input.Available();
+                size_t len = decoder.ChunkLength(data, avail, chunk_size, at_eof);
+                if (len == 0) break;            // (need more input)
+                Submit(data, len, input.IsMapped());
+                input.Consume(len);
+                if (stats) stats->bytes_read += len;
+            }
+            if (!more) break;
+            if (input.Idle()) {
+                Flush();
+                input.Wait();
+            }
+        }
+        return Drain();
+    }
+
+    // hand every submitted chunk to the output, and flush it
+    void Flush() {
+        while (!inflight.empty()) EmitFront();
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        output.Flush();
+        if (series) series->Flush();
+        if (stats) stats->output_seconds += StatSeconds(t0);
+    }
+
+    // queue one chunk (whole records) for decoding, for callers that feed
+    //   the pipeline themselves; "stable" data stays valid until Drain()
+    //   (e.g. mapped pages), other data is copied if a worker needs it
+    void Submit(const uint8_t *data, size_t len, bool stable) {
+        uint64_t first_frame = n_events, first_line = n_lines;
+        uint64_t chunk_lines = 0;
+        n_events += decoder.CountEvents(data, len, chunk_lines);
+        n_lines += chunk_lines;
+
+        if (n_threads == 1) {                   // (decode straight to output)
+            PacketTee tee(output, series);
+            EventSink &sink = series ? (EventSink &)tee : output;
+            if (!stats) {
+                decoder.Decode(data, len, first_frame, first_line, sink, NULL);
+                return;
+            }
+            std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+            decoder.Decode(data, len, first_frame, first_line, sink, &stats->counts);
+            stats->decode_seconds += StatSeconds(t0);
+            return;
+        }
+        for (unsigned t=workers.size(); t < n_threads && !pool; t++) {
+            workers.push_back(std::thread(&DecodePipeline::Work, this));
+        }
+
+        Chunk *chunk = new Chunk(writer, series != NULL);
+        chunk->first_frame = first_frame;
+        chunk->first_line = first_line;
+        if (stable) {                           // (mapped pages stay valid)
+            chunk->data = data;
+        } else {                                // (read() buffer is reused)
+            chunk->copy.assign(data, data + len);
+            chunk->data = &chunk->copy[0];
+        }
+        chunk->len = len;
+
+        while (inflight.size() >= 2 * n_threads) EmitFront();
+        inflight.push_back(chunk);
+        if (pool) {
+            pool->Push(self, [this, chunk] { DecodeChunk(chunk); });
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending.push_back(chunk);
+        }
+        queued.notify_one();
+    }
+
+    // finish every submitted chunk and stop the pool; returns the number
+    //   of event-list frames
+    uint64_t Drain() {
+        while (!inflight.empty()) EmitFront();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        queued.notify_all();
+        for (size_t t=0; t < workers.size(); t++) workers[t].join();
+        workers.clear();
+        stopping = false;
+        return n_events;
+    }
+
+private:
+    struct Chunk {
+        const uint8_t           *data;
+        size_t                  len;
+        std::vector<uint8_t>    copy;           // (streamed input only)
+        uint64_t                first_frame;
+        uint64_t                first_line;
+        ChunkResult             result;
+        DecodeCounts            counts;         // (--stats)
+        double                  seconds;        // (--stats) decode time
+        bool                    done;
+
+        Chunk(const EventWriter *text, bool keep_packets)
+            : data(NULL), len(0), first_frame(0), first_line(0), result(text, keep_packets),
+              seconds(0), done(false) {}
+    };
+
+    const ChunkDecoder          &decoder;
+    EventSink                   &output;
+    unsigned                    n_threads;
+    EventWriter                 *writer;        // (ASCII output, or NULL)
+    RunStats                    *stats;         // (--stats, or NULL)
+    PacketSeries                *series;        // (or NULL)
+    TaskPool                    *pool;          // (batch runs, or NULL)
+    unsigned                    self;           // (this thread, in "pool")
+
+    std::vector<std::thread>    workers;
+    std::mutex                  mutex;
+    std::condition_variable     queued;         // a chunk is waiting
+    std::condition_variable     finished;       // a chunk has been decoded
+    std::deque<Chunk *>         pending;        // not yet picked up
+    std::deque<Chunk *>         inflight;       // submitted, in input order
+    bool                        stopping;
+    uint64_t                    n_events;
+    uint64_t                    n_lines;        // (text input only)
+
+    // wait for the oldest chunk, then hand its events to the output
+    void EmitFront() {
+        Chunk *chunk = inflight.front();
+        while (pool && !Done(chunk)) {
+            // help out; if nothing is queued, the chunk is being decoded
+            if (!pool->RunOne(self)) break;
+        }
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            finished.wait(lock, [chunk] { return chunk->done; });
+        }
+        inflight.pop_front();
+        if (!stats) {
+            chunk->result.Emit(output, writer, series);
+        } else {
+            std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+            chunk->result.Emit(output, writer, series);
+            stats->output_seconds += StatSeconds(t0);
+            stats->decode_seconds += chunk->seconds;
+            stats->counts.Add(chunk->counts);
+        }
+        delete chunk;
+    }
+
+    bool Done(Chunk *chunk) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return chunk->done;
+    }
+
+    void Work() {
+        while (true) {
+            Chunk *chunk;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                queued.wait(lock, [this] { return stopping || !pending.empty(); });
+                if (pending.empty()) return;
+                chunk = pending.front();
+                pending.pop_front();
+            }
+            DecodeChunk(chunk);
+        }
+    }
+
+    // decode one chunk (on a worker or pool thread) and mark it done
+    void DecodeChunk(Chunk *chunk) {
+        if (!stats) {
+            decoder.Decode(chunk->data, chunk->len, chunk->first_frame, chunk->first_line,
+                           chunk->result, NULL);
+        } else {
+            std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+            decoder.Decode(chunk->data, chunk->len, chunk->first_frame, chunk->first_line,
+                           chunk->result, &chunk->counts);
+            chunk->seconds = StatSeconds(t0);
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            chunk->done = true;
+        }
+        finished.notify_all();
+    }
+
+    DecodePipeline(const DecodePipeline &);
+    DecodePipeline &operator=(const DecodePipeline &);
+};
+
+#endif
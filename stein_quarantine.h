@@ -0,0 +1,90 @@
+//
+// stein_quarantine.h -- side file for input that fails validation
+//  ("--quarantine=FILE"): each rejected packet is written out verbatim,
+//  after a comment line saying where it was and what was wrong with it:
+//
+//    # line 1043 (packet 1021): header 0x00, not 0xAF
+//    0x00, 0x4A, 0x20, ...
+//
+// Line numbers count from 1, over all lines of the input (blank ones
+//  too), so a glitch can be found in the original dump; the packet number
+//  is the packet's place among the non-blank lines, as in the event list
+//  (frames 198*P .. 198*P + 197).  Decoding threads add to the file under
+//  a lock -- rejects are rare -- so with -j N the entries may come out of
+//  order, each with its own line number.
+//
+//
+// Copyright 2013 Karl Yando
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef STEIN_QUARANTINE_H
+#define STEIN_QUARANTINE_H
+
+#include <fcntl.h>
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "stein_output.h"
+
+class Quarantine {
+public:
+    Quarantine() : fd(-1), count(0), failed(false) {}
+    ~Quarantine() { Close(); }
+
+    // write rejected packets to "path" (without it, they are only counted)
+    bool Open(const char *path) {
+        fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        return fd >= 0;
+    }
+
+    // returns false if writing the file failed
+    bool Close() {
+        if (fd >= 0 && close(fd) != 0) failed = true;
+        fd = -1;
+        return !failed;
+    }
+
+    // one rejected packet ("line" and "packet" counted from 0)
+    void Add(uint64_t line, uint64_t packet, const char *reason, const char *text, size_t len) {
+        std::lock_guard<std::mutex> lock(mutex);
+        count++;
+        if (fd < 0 || failed) return;
+        char note [160];
+        int n = snprintf(note, sizeof(note), "# line %llu (packet %llu): %s\n",
+                         (unsigned long long)line + 1, (unsigned long long)packet, reason);
+        if (!WriteAll(fd, note, n) || !WriteAll(fd, text, len) || !WriteAll(fd, "\n", 1)) {
+            failed = true;
+        }
+    }
+
+    // packets rejected so far
+    uint64_t Count() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return count;
+    }
+
+private:
+    int         fd;
+    uint64_t    count;
+    bool        failed;
+    std::mutex  mutex;
+
+    Quarantine(const Quarantine &);
+    Quarantine &operator=(const Quarantine &);
+};
+
+#endif
@@ -0,0 +1,98 @@
+//
+// stein_raw.h -- the 32-bit event records of raw STEIN binary data, and
+//  RawRecordDecoder, which turns them into events.  Used by
+//  rawstein_extract.cpp and by the decoding library (stein_capi.cpp).
+//
+//
+// Copyright 2013 Karl Yando
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef STEIN_RAW_H
+#define STEIN_RAW_H
+
+#include <stdint.h>
+
+#include "stein_layout.h"
+#include "stein_output.h"
+#include "stein_pipeline.h"
+#include "stein_stats.h"
+
+// 32-bit data packets, so each packet is actually spread across four CHAR bytes (8 hex characters)
+const uint64_t record_size = 4L;
+
+// events are written out as they are decoded, and input pages are
+//   released behind the decoder, so memory use does not grow with
+//   the size of the datafile (64-bit counters, so >4 GB is fine).
+//   Every record stands alone, so chunks of them may be decoded on
+//   several threads at once with "-j N" (see stein_pipeline.h).
+//   With "--simulate-fsw", EVCODE 0 events are washed down to what the
+//   flight software would have telemetered (as EX_PLOT_RAW does in IDL,
+//   scripts/dusty/stein_simfsw.pro): ADD = -1, the 2 LSBs of TIME STAMP
+//   dropped, and DATA log-compressed to 7 bits (fsw_log in stein_layout.h).
+class RawRecordDecoder : public ChunkDecoder {
+public:
+    explicit RawRecordDecoder(bool simulate_fsw = false) : simulate_fsw(simulate_fsw) {}
+
+    size_t ChunkLength(const uint8_t * /*data*/, size_t avail, size_t want,
+                       bool /*at_eof*/) const {
+        size_t n = (avail < want) ? avail : want;
+        return n - (n % record_size);
+    }
+
+    uint64_t CountEvents(const uint8_t * /*data*/, size_t len, uint64_t &n_lines) const {
+        n_lines = 0;
+        return len / record_size;
+    }
+
+    void Decode(const uint8_t *raw, size_t len, uint64_t first_frame, uint64_t /*first_line*/,
+                EventSink &output, DecodeCounts *counts) const {
+        uint64_t n_frames = len / record_size;
+        uint64_t n_written = 0;
+        int32_t evcode, add, det_id, timestamp, data;
+        // (records outside --frames are not decoded at all)
+        if (filter && !filter->AnyFrame(first_frame, n_frames)) return;
+
+        for (uint64_t j=0L; j < n_frames; j++) {
+            // EVCODE(1:0) ADD(0) DET ID(4:0) [1st CHAR], TIME STAMP(7:0)
+            //   [2nd CHAR], DATA(15:0) [3rd + 4th CHARs]; STEIN data is
+            //   properly interpreted as a *signed* 16-bit int, so DATA is
+            //   "shifted" to a *true* unsigned value (see RawLayout in
+            //   stein_layout.h)
+            DecodeRawEvent(raw + record_size*j, evcode, add, det_id, timestamp, data);
+            if (simulate_fsw && evcode == 0) {
+                add = -1;
+                timestamp >>= 2;
+                data = fsw_log.bin[data >> 8];
+            }
+            if (counts) counts->Event(evcode, add, det_id);  // (--stats)
+
+            // write out results (absolute frame number), unless filtered
+            //   out (after --simulate-fsw, i.e. on the values written)
+            if (filter && !filter->Pass(first_frame + j, evcode, add, det_id, timestamp)) continue;
+            output.Event(first_frame + j, evcode, add, det_id, timestamp, data);
+            n_written++;
+        }
+        if (counts) {
+            counts->records += n_frames;
+            counts->events += n_frames;
+            counts->written += n_written;
+        }
+    }
+
+private:
+    bool    simulate_fsw;
+};
+
+#endif
@@ -0,0 +1,198 @@
+//
+// stein_stats.h -- run statistics ("--stats"): a JSON summary of a run,
+//  written at the end so the event list on stdout is untouched -- to
+//  stderr, after the tool's other notes there, or with "--stats=FILE" to
+//  a file of its own (the one to parse by machine).
+//
+//    {"tool": "fsw_steinunpack", "threads": 1, "wall_seconds": 0.81,
+//     "stages": {"read": 0.01, "decode": 0.77, "output": 0.02},
+//     "bytes_read": 30840000, "records": 10000, "events": 1980000,
+//     "events_written": 1980000, "evcode": [1584000, 99000, 99000, 198000],
+//     "det_id": {"0": 49500, "1": 49500, ...}, "noise_det_id": {"0": 49700, ...},
+//     "invalid": {"packets_skipped": 0, "short_packet": 0, "malformed_token": 0,
+//                 "bad_header": 0, "bad_length": 0, "bad_spare": 0,
+//                 "bad_sub20_line": 0},
+//     "throughput": {"mb_per_s": 38.1, "events_per_s": 2444444},
+//     "peak_rss_kb": 5120}
+//
+// "records" are the FSW packets or raw 4-byte records decoded; packets
+//  that fail validation are skipped, and counted under "invalid" by fault.
+//  "det_id" counts the EVCODE 0 hits of each detector pixel (DET_ID 0..31);
+//  the DET_ID of EVCODE 3 / ADD 0 (noise) events -- 1 bit in FSW dumps --
+//  is counted apart, under "noise_det_id", and that of other events (raw
+//  data only) not at all.
+//  Stage times are seconds: "read" is time spent fetching input, "decode"
+//  the time spent in the decoders, summed over all decoding threads (with
+//  -j 1, events are formatted and written from inside the decoder, so this
+//  includes output; SUB-20 text packing counts here too), and "output" the
+//  time the main thread spends handing decoded chunks to the output and
+//  finishing it.
+//
+// Decoders count into a DecodeCounts of their own for every chunk (plain
+//  counters, no locking), and the pipeline adds them up in input order;
+//  the timers are read once per chunk, so collection costs next to nothing.
+//
+//
+// Copyright 2013 Karl Yando
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef STEIN_STATS_H
+#define STEIN_STATS_H
+
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+
+// why an FSW packet failed validation (see fsw_steinunpack.cpp)
+enum PacketFault { PACKET_OK, PACKET_SHORT, PACKET_MALFORMED, PACKET_HEADER,
+                   PACKET_LENGTH, PACKET_SPARE };
+
+// counters kept by a decoder while it decodes one chunk
+struct DecodeCounts {
+    uint64_t    records;                // packets / raw records decoded
+    uint64_t    events;                 // events decoded
+    uint64_t    written;                // events passed on (after filters)
+    uint64_t    evcode [4];
+    uint64_t    det_id [32];            // EVCODE 0 hits, by DET_ID
+    uint64_t    noise_det_id [32];      // EVCODE 3 / ADD 0 events, by DET_ID
+    uint64_t    short_packet;           // FSW packets skipped, by PacketFault
+    uint64_t    malformed_token;
+    uint64_t    bad_header;
+    uint64_t    bad_length;
+    uint64_t    bad_spare;
+    uint64_t    bad_sub20_line;         // SUB-20 lines neither blank nor a record
+
+    DecodeCounts() { Clear(); }
+    void Clear() { memset(this, 0, sizeof(*this)); }
+
+    inline void Event(int32_t ev, int32_t add, int32_t det) {
+        evcode[ev & 3]++;
+        if (det < 0) return;
+        if (ev == 0) det_id[det & 31]++;
+        else if (ev == 3 && add == 0) noise_det_id[det & 31]++;
+    }
+
+    void Fault(PacketFault fault) {
+        switch (fault) {
+        case PACKET_SHORT:      short_packet++;     break;
+        case PACKET_MALFORMED:  malformed_token++;  break;
+        case PACKET_HEADER:     bad_header++;       break;
+        case PACKET_LENGTH:     bad_length++;       break;
+        case PACKET_SPARE:      bad_spare++;        break;
+        default:                                    break;
+        }
+    }
+
+    uint64_t Skipped() const {
+        return short_packet + malformed_token + bad_header + bad_length + bad_spare;
+    }
+
+    void Add(const DecodeCounts &o) {
+        const uint64_t *from = (const uint64_t *)&o;
+        uint64_t *to = (uint64_t *)this;
+        for (size_t i=0; i < sizeof(*this) / sizeof(uint64_t); i++) to[i] += from[i];
+    }
+};
+
+// seconds since "t0"
+inline double StatSeconds(std::chrono::steady_clock::time_point t0) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+struct RunStats {
+    std::chrono::steady_clock::time_point   start;
+    double          read_seconds, decode_seconds, output_seconds;
+    uint64_t        bytes_read;
+    DecodeCounts    counts;
+
+    RunStats() : start(std::chrono::steady_clock::now()), read_seconds(0),
+                 decode_seconds(0), output_seconds(0), bytes_read(0) {}
+
+    // add the stage times and counts of "o" (e.g. one file of a batch)
+    void Add(const RunStats &o) {
+        read_seconds += o.read_seconds;
+        decode_seconds += o.decode_seconds;
+        output_seconds += o.output_seconds;
+        bytes_read += o.bytes_read;
+        counts.Add(o.counts);
+    }
+
+    // the JSON summary (one object), e.g. to stderr
+    void Write(FILE *out, const char *tool, unsigned threads) const {
+        double wall = StatSeconds(start);
+        struct rusage usage;
+        long peak_kb = (getrusage(RUSAGE_SELF, &usage) == 0) ? usage.ru_maxrss : 0;
+        const DecodeCounts &c = counts;
+
+        fprintf(out, "{\"tool\": \"%s\", \"threads\": %u, \"wall_seconds\": %.6f,\n",
+                tool, threads, wall);
+        fprintf(out, " \"stages\": {\"read\": %.6f, \"decode\": %.6f, \"output\": %.6f},\n",
+                read_seconds, decode_seconds, output_seconds);
+        fprintf(out, " \"bytes_read\": %llu, \"records\": %llu, \"events\": %llu,"
+                " \"events_written\": %llu,\n", (unsigned long long)bytes_read,
+                (unsigned long long)c.records, (unsigned long long)c.events,
+                (unsigned long long)c.written);
+        fprintf(out, " \"evcode\": [%llu, %llu, %llu, %llu],\n",
+                (unsigned long long)c.evcode[0], (unsigned long long)c.evcode[1],
+                (unsigned long long)c.evcode[2], (unsigned long long)c.evcode[3]);
+        fprintf(out, " \"det_id\": {");
+        const char *sep = "";
+        for (int d=0; d < 32; d++) {
+            if (c.det_id[d] == 0) continue;
+            fprintf(out, "%s\"%d\": %llu", sep, d, (unsigned long long)c.det_id[d]);
+            sep = ", ";
+        }
+        fprintf(out, "}, \"noise_det_id\": {");
+        sep = "";
+        for (int d=0; d < 32; d++) {
+            if (c.noise_det_id[d] == 0) continue;
+            fprintf(out, "%s\"%d\": %llu", sep, d, (unsigned long long)c.noise_det_id[d]);
+            sep = ", ";
+        }
+        fprintf(out, "},\n");
+        fprintf(out, " \"invalid\": {\"packets_skipped\": %llu, \"short_packet\": %llu,"
+                " \"malformed_token\": %llu,\n             \"bad_header\": %llu,"
+                " \"bad_length\": %llu, \"bad_spare\": %llu, \"bad_sub20_line\": %llu},\n",
+                (unsigned long long)c.Skipped(), (unsigned long long)c.short_packet,
+                (unsigned long long)c.malformed_token, (unsigned long long)c.bad_header,
+                (unsigned long long)c.bad_length, (unsigned long long)c.bad_spare,
+                (unsigned long long)c.bad_sub20_line);
+        fprintf(out, " \"throughput\": {\"mb_per_s\": %.3f, \"events_per_s\": %.0f},\n",
+                wall > 0 ? bytes_read / wall / 1e6 : 0.0, wall > 0 ? c.events / wall : 0.0);
+        fprintf(out, " \"peak_rss_kb\": %ld}\n", peak_kb);
+    }
+
+    // the JSON summary to file "path" (NULL: stderr); returns false, with
+    //   a message on stderr, if the file cannot be written
+    bool Write(const char *path, const char *tool, unsigned threads) const {
+        if (!path) {
+            Write(stderr, tool, threads);
+            return true;
+        }
+        FILE *out = fopen(path, "w");
+        bool ok = (out != NULL);
+        if (ok) {
+            Write(out, tool, threads);
+            ok = !ferror(out);
+            ok = (fclose(out) == 0) && ok;
+        }
+        if (!ok) fprintf(stderr, "write to %s failed\n", path);
+        return ok;
+    }
+};
+
+#endif
@@ -0,0 +1,203 @@
+//
+// stein_synth.h -- deterministic synthetic STEIN data, for benchmarks and
+//  for exercising the tools without a real (large, sensitive) capture:
+//  FSW ASCII hex dumps, raw 4-byte binary records and SUB-20 text logs.
+//  Used by stein_gendata.cpp (files) and stein_bench.cpp (in memory).
+//
+// Events are drawn from a SynthMix: relative weights of EVCODE 0..3 and of
+//  ADD 0 / 1, and the set of DET_ID values to use; TIME_STAMP and DATA are
+//  uniform over their fields.  Reports are encoded with the layouts of
+//  stein_layout.h, so the tools decode them back to the drawn values.  The
+//  same seed and mix always give the same bytes.
+//
+//    FSW packet   0xAF, packet time (month / day / hour / min / sec /
+//                 fraction, one second per packet from January 12,
+//                 13:46:40), 495-byte STEIN frame (198
+//                 reports), 8 bytes housekeeping, 4 zero spare bytes; written
+//                 as one line of 514 "0xNN," tokens
+//    raw record   EVCODE / ADD / DET_ID, TIME_STAMP, DATA (offset binary)
+//    SUB-20 line  "80 00 00 00" padded to column 48, then "| ...."
+//
+//
+// Copyright 2013 Karl Yando
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef STEIN_SYNTH_H
+#define STEIN_SYNTH_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stein_filter.h"
+#include "stein_fsw.h"
+#include "stein_kernel.h"
+#include "stein_layout.h"
+
+static const uint16_t synth_packet_bytes = 514;         // (tokens per FSW line)
+static const size_t   synth_max_fsw_line = 6 * synth_packet_bytes + 1;
+static const size_t   synth_max_sub20_line = 64;
+static const uint32_t synth_first_second = 1000000;     // (time of packet 0, s)
+
+struct SynthMix {
+    uint32_t    evcode_weight [4];      // relative frequency of EVCODE 0..3
+    uint32_t    add_weight [2];         // ADD 0 / 1 (FSW: EVCODE 3 only)
+    uint32_t    det_ids;                // DET_ID values to draw (bit n: n)
+
+    SynthMix() : evcode_weight{ 80, 5, 5, 10 }, add_weight{ 1, 1 }, det_ids(0xffffffffu) {}
+};
+
+// "w0,w1,..." into "n" weights (not all zero); returns false if malformed
+inline bool ParseWeights(const char *text, uint32_t weight[], int n) {
+    uint64_t total = 0;
+    for (int k=0; k < n; k++) {
+        char *end;
+        if (*text < '0' || *text > '9') return false;
+        unsigned long w = strtoul(text, &end, 10);
+        if (w > 1000000 || *end != ((k == n - 1) ? '\0' : ',')) return false;
+        weight[k] = (uint32_t)w;
+        total += w;
+        text = end + 1;
+    }
+    return total > 0;
+}
+
+// mix options shared by stein_gendata and stein_bench:
+//    --evcode-mix=W0,W1,W2,W3  --add-mix=W0,W1  --det-ids=SET
+//   returns 1 if "arg" was one of them, 0 if not, -1 if malformed (a
+//   message has been printed to stderr)
+inline int ParseMixOption(const char *arg, SynthMix &mix) {
+    bool ok;
+    uint64_t set;
+    if (strncmp(arg, "--evcode-mix=", 13) == 0) ok = ParseWeights(arg + 13, mix.evcode_weight, 4);
+    else if (strncmp(arg, "--add-mix=", 10) == 0) ok = ParseWeights(arg + 10, mix.add_weight, 2);
+    else if (strncmp(arg, "--det-ids=", 10) == 0) {
+        ok = EventFilter::ParseValueSet(arg + 10, 0, 31, set);
+        mix.det_ids = (uint32_t)set;
+    } else {
+        return 0;
+    }
+    if (!ok) fprintf(stderr, "invalid mix: %s\n", arg);
+    return ok ? 1 : -1;
+}
+
+// pack 198 20-bit reports into a 495-byte frame (inverse of ExtractEvents)
+inline void PackFrame(const uint32_t reports[], uint8_t frame[]) {
+    for (uint16_t i=0; i < frame_events/2; i++) {
+        uint32_t e1 = reports[2*i], e2 = reports[2*i + 1];
+        frame[5*i]     = e1 & 0xff;
+        frame[5*i + 1] = (e1 >> 8) & 0xff;
+        frame[5*i + 2] = ((e1 >> 16) & 0x0f) | ((e2 & 0x0f) << 4);
+        frame[5*i + 3] = (e2 >> 4) & 0xff;
+        frame[5*i + 4] = (e2 >> 12) & 0xff;
+    }
+}
+
+class SynthGenerator {
+public:
+    explicit SynthGenerator(uint64_t seed = 12345, const SynthMix &mix = SynthMix())
+        : state(seed * 0x9e3779b97f4a7c15ULL + 1), mix(mix), n_dets(0) {
+        for (uint32_t d=0; d < 32; d++) {
+            if (mix.det_ids & (1u << d)) det_list[n_dets++] = d;
+        }
+        if (n_dets == 0) det_list[n_dets++] = 0;
+    }
+
+    // (xorshift64*)
+    uint32_t Next() {
+        state ^= state >> 12; state ^= state << 25; state ^= state >> 27;
+        return (uint32_t)((state * 0x2545f4914f6cdd1dULL) >> 32);
+    }
+
+    // one 20-bit FSW event report
+    uint32_t FswReport() {
+        int32_t evcode = Pick(mix.evcode_weight, 4);
+        uint32_t r = Next();
+        switch (evcode) {
+        case 0:  return FswEvcode0::Encode(0, -1, Det(), r, r >> 8);
+        case 1:  return FswEvcode1::Encode(1, -1, -1, r, r >> 8);
+        case 2:  return FswEvcode2::Encode(2, -1, -1, r, r >> 8);
+        default:
+            if (Pick(mix.add_weight, 2) == 0) return FswEvcode3Add0::Encode(3, 0, Det(), -1, r >> 8);
+            return FswEvcode3Add1::Encode(3, 1, -1, r, r >> 8);
+        }
+    }
+
+    // FSW packet number "n" (synth_packet_bytes bytes)
+    void FswPacket(uint64_t n, uint8_t packet[]) {
+        packet[0] = 0xAF;
+        PacketTimestamp((synth_first_second + n) * packet_time_ticks, packet + 1);
+        uint32_t reports [frame_events];
+        for (uint16_t i=0; i < frame_events; i++) reports[i] = FswReport();
+        PackFrame(reports, packet + 7);
+        uint16_t spare = 7 + frame_bytes + 8;
+        for (uint16_t j=7 + frame_bytes; j < spare; j++) packet[j] = (uint8_t)Next();
+        memset(packet + spare, 0, synth_packet_bytes - spare);
+    }
+
+    // one raw 4-byte record (big-endian)
+    void RawRecord(uint8_t record[4]) {
+        int32_t evcode = Pick(mix.evcode_weight, 4);
+        int32_t add = Pick(mix.add_weight, 2);
+        uint32_t r = Next();
+        uint32_t word = RawLayout::Encode(evcode, add, Det(), r, r >> 8);
+        record[0] = word >> 24; record[1] = word >> 16; record[2] = word >> 8; record[3] = word;
+    }
+
+    // a packet as one dump line ("0xAF, 0x..., ... 0xNN,\n"); returns its length
+    static size_t FswLine(const uint8_t packet[], char *line) {
+        static const char digits[] = "0123456789ABCDEF";
+        char *p = line;
+        for (uint16_t j=0; j < synth_packet_bytes; j++) {
+            if (j) *p++ = ' ';
+            *p++ = '0'; *p++ = 'x';
+            *p++ = digits[packet[j] >> 4]; *p++ = digits[packet[j] & 15];
+            *p++ = ',';
+        }
+        *p++ = '\n';
+        return p - line;
+    }
+
+    // a record as one SUB-20 log line; returns its length
+    static size_t Sub20Line(const uint8_t record[4], char *line) {
+        int n = snprintf(line, synth_max_sub20_line, "%02X %02X %02X %02X%*s| ",
+                         record[0], record[1], record[2], record[3], 37, "");
+        for (int k=0; k < 4; k++) {
+            line[n++] = (record[k] >= 0x20 && record[k] < 0x7f) ? (char)record[k] : '.';
+        }
+        line[n++] = '\n';
+        return n;
+    }
+
+private:
+    uint64_t    state;
+    SynthMix    mix;
+    uint32_t    det_list [32];
+    uint32_t    n_dets;
+
+    int32_t Pick(const uint32_t weight[], int n) {
+        uint32_t total = 0;
+        for (int k=0; k < n; k++) total += weight[k];
+        uint32_t r = Next() % total;
+        int k = 0;
+        while (r >= weight[k]) r -= weight[k++];
+        return k;
+    }
+
+    int32_t Det() { return det_list[Next() % n_dets]; }
+};
+
+#endif
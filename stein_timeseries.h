@@ -0,0 +1,195 @@
+//
+// stein_timeseries.h -- per-packet time series of FSW dumps, written in the
+//  same pass as the event list: the housekeeping subframe of every packet
+//  ("--housekeeping=FILE") and count rates per time bin ("--rates=FILE").
+//
+// Packet times are seconds since January 1, 00:00 of the dump's year (see
+//  PacketTime, stein_fsw.h).
+//
+// Housekeeping: one line per packet, the packet number and time (seconds)
+//  and the 8 housekeeping bytes, as received:
+//
+//    # packet / PACKET_TIME / HK0 / HK1 / ... / HK7
+//    0 1000000.00000 16 0 255 3 0 0 129 4
+//
+// Rates: packets are grouped into bins of "--rate-bin=S" seconds of packet
+//  time (aligned to multiples of S since January 1, so 60 s bins start on
+//  the minute), and one line is written per bin that
+//  holds any packet:
+//
+//    # BIN_START / SECONDS / PACKETS / TRIGGERS_PER_S / EVENTS_PER_S / DET0 / ... / DET31
+//    1000020.00000 60.00000 60 412.250 398.100 1.950 2.017 ...
+//
+//  TRIGGERS_PER_S and EVENTS_PER_S average the DATA of the FSW's own sweep
+//  reports (EVCODE 1: # of triggers per second, EVCODE 2: # of events per
+//  second) in the bin, -1 if there were none; these reports carry no
+//  DET_ID, so they are instrument totals.  DET0 .. DET31 are EVCODE 0
+//  events per second for each DET_ID: events in the bin over S.  Bins only
+//  partly covered by packets (at either end, or around a gap) read low;
+//  PACKETS shows how full a bin is.  A packet time that goes backwards
+//  starts a new bin.
+//
+// Both series are built from PacketInfo records (stein_output.h), which
+//  the decode pipeline hands over in input order, so "-j N" gives the same
+//  files.  Event filters do not apply (--frames, --from and --to do: only
+//  decoded packets are counted), and packets that fail validation are not
+//  included.  LOAD_EVENTLIST (load_eventlist.pro) reads either table.
+//
+//
+// Copyright 2013 Karl Yando
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef STEIN_TIMESERIES_H
+#define STEIN_TIMESERIES_H
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "stein_output.h"
+
+class PacketSeries {
+public:
+    PacketSeries() : housekeeping(NULL), rates(NULL), hk_fd(-1), rate_fd(-1), bin_ticks(0),
+                     have_bin(false), failed(false) {}
+    ~PacketSeries() { Finish(); }
+
+    // write the housekeeping series to "path"; returns false if it cannot
+    //   be created
+    bool OpenHousekeeping(const char *path) {
+        hk_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (hk_fd < 0) return false;
+        housekeeping = new EventWriter(hk_fd, 1 << 16);
+        housekeeping->Write("# packet / PACKET_TIME / HK0 / HK1 / HK2 / HK3 / HK4 / HK5"
+                            " / HK6 / HK7\n");
+        return true;
+    }
+
+    // write count rates in bins of "ticks" (1/packet_time_ticks s) to "path"
+    bool OpenRates(const char *path, uint64_t ticks) {
+        rate_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (rate_fd < 0) return false;
+        rates = new EventWriter(rate_fd, 1 << 16);
+        bin_ticks = ticks;
+        rates->Write("# BIN_START / SECONDS / PACKETS / TRIGGERS_PER_S / EVENTS_PER_S");
+        char name [16];
+        for (int d=0; d < 32; d++) {
+            snprintf(name, sizeof(name), " / DET%d", d);
+            rates->Write(name);
+        }
+        rates->Write("\n");
+        return true;
+    }
+
+    bool Active() const { return housekeeping || rates; }
+
+    // the next packet, in input order
+    void Add(const PacketInfo &info) {
+        if (housekeeping) {
+            char line [160];
+            char *p = FormatUnsigned(line, info.packet);
+            *p++ = ' ';
+            p = FormatPacketTime(p, info.time);
+            for (int k=0; k < 8; k++) {
+                *p++ = ' ';
+                p = FormatUnsigned(p, info.housekeeping[k]);
+            }
+            *p++ = '\n';
+            housekeeping->Write(line, p - line);
+        }
+        if (rates) {
+            uint64_t b = info.time / bin_ticks;
+            if (!have_bin || b != bin) {
+                WriteBin();
+                memset(&sum, 0, sizeof(sum));
+                n_packets = 0;
+                bin = b;
+                have_bin = true;
+            }
+            n_packets++;
+            for (int d=0; d < 32; d++) sum.det_events[d] += info.det_events[d];
+            for (int k=0; k < 2; k++) {
+                sum.sweep_sum[k] += info.sweep_sum[k];
+                sum.sweep_n[k] += info.sweep_n[k];
+            }
+        }
+    }
+
+    // push the lines written so far to the files (the open rate bin stays
+    //   open until a packet of a later bin, or the end of the run)
+    void Flush() {
+        if (housekeeping) housekeeping->Flush();
+        if (rates) rates->Flush();
+    }
+
+    // end of run: write the last bin and close the files; returns false if
+    //   writing either file failed
+    bool Finish() {
+        if (rates) {
+            WriteBin();
+            have_bin = false;
+        }
+        Close(housekeeping, hk_fd);
+        Close(rates, rate_fd);
+        return !failed;
+    }
+
+private:
+    EventWriter     *housekeeping;
+    EventWriter     *rates;
+    int             hk_fd, rate_fd;
+    uint64_t        bin_ticks;
+    bool            have_bin;
+    uint64_t        bin;                // (current bin: bin * bin_ticks ..)
+    uint64_t        n_packets;          // packets in the current bin
+    struct {
+        uint64_t    det_events [32];
+        uint64_t    sweep_sum [2];
+        uint64_t    sweep_n [2];
+    }               sum;                // current bin totals
+    bool            failed;
+
+    void WriteBin() {
+        if (!have_bin) return;
+        double seconds = (double)bin_ticks / packet_time_ticks;
+        char line [768];
+        char *p = FormatPacketTime(line, bin * bin_ticks);
+        p += snprintf(p, 64, " %.5f %llu", seconds, (unsigned long long)n_packets);
+        for (int k=0; k < 2; k++) {
+            if (sum.sweep_n[k]) p += snprintf(p, 32, " %.3f", (double)sum.sweep_sum[k] / sum.sweep_n[k]);
+            else p += snprintf(p, 32, " -1");
+        }
+        for (int d=0; d < 32; d++) p += snprintf(p, 20, " %.3f", sum.det_events[d] / seconds);
+        *p++ = '\n';
+        rates->Write(line, p - line);
+    }
+
+    void Close(EventWriter *&writer, int &fd) {
+        if (!writer) return;
+        writer->Flush();
+        if (writer->Failed()) failed = true;
+        delete writer;
+        writer = NULL;
+        if (close(fd) != 0) failed = true;
+        fd = -1;
+    }
+
+    PacketSeries(const PacketSeries &);
+    PacketSeries &operator=(const PacketSeries &);
+};
+
+#endif
@@ -14,6 +14,9 @@
 # >>> bin = sub20.read_sub20_hexbytes("log.log")
 # >>> sub20.write_sub20_hexbytes(data=bin, filename="binary.log")
 #
+# (rawstein_extract reads "log.log" directly with "--sub20", and writes
+#  "binary.log" as well with "--write-binary=binary.log")
+#
 # Author:
 #  Karl Yando
 #